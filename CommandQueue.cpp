@@ -0,0 +1,130 @@
+#include "CommandQueue.hpp"
+#include "VGL.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Set on the workers, which execute the commands instead of recording them
+static thread_local bool gIsWorkerThread = false;
+
+CommandQueue::~CommandQueue() {
+    setEnabled(nullptr, false);
+}
+
+void CommandQueue::setEnabled(GLContext *ctx, bool isEnabled) {
+    if (isEnabled == this->isEnabled()) {
+        return;
+    }
+    if (isEnabled) {
+        mIsStopping = false;
+        mWorker = std::thread(&CommandQueue::workerMain, this, ctx);
+        return;
+    }
+
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIsStopping = true;
+    }
+    mWakeCond.notify_all();
+    mWorker.join();
+    mWorker = std::thread();
+}
+
+bool CommandQueue::isEnabled() const {
+    return mWorker.joinable();
+}
+
+bool CommandQueue::isRecording() const {
+    return !gIsWorkerThread && isEnabled();
+}
+
+uint8_t *CommandQueue::allocate(CqExecuteFunc func, size_t size) {
+    if (mRecording.size >= CQ_BATCH_SIZE) {
+        submit();
+    }
+
+    CqCommandHeader header;
+    header.func = func;
+    header.size = static_cast<uint32_t>((size + 7) & ~static_cast<size_t>(7));
+    const size_t offset = mRecording.size;
+    const size_t end = offset + sizeof(header) + header.size;
+    if (end > mRecording.capacity) {
+        // Only large draws and texture uploads make a batch grow past the usual size
+        const size_t capacity = std::max({ end, 2*mRecording.capacity, CQ_BATCH_SIZE + CQ_BATCH_SIZE / 4 });
+        std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+        if (offset) {
+            memcpy(data.get(), mRecording.data.get(), offset);
+        }
+        mRecording.data = std::move(data);
+        mRecording.capacity = capacity;
+    }
+    mRecording.size = end;
+    new (&mRecording.data[offset]) CqCommandHeader(header);
+    return &mRecording.data[offset + sizeof(header)];
+}
+
+uint64_t CommandQueue::flush() {
+    if (mRecording.size != 0) {
+        submit();
+    }
+    return mSubmittedCount;
+}
+
+bool CommandQueue::isSignaled(uint64_t fence) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mExecutedCount >= fence;
+}
+
+void CommandQueue::wait(uint64_t fence) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCond.wait(lock, [this, fence] { return mExecutedCount >= fence; });
+}
+
+void CommandQueue::submit() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCond.wait(lock, [this] { return mPendingBatches.size() < CQ_MAX_PENDING_BATCHES; });
+        mPendingBatches.push_back(std::move(mRecording));
+        mSubmittedCount++;
+        mRecording = CqBatch();
+        if (!mFreeBatches.empty()) {
+            mRecording = std::move(mFreeBatches.back());
+            mFreeBatches.pop_back();
+        }
+    }
+    mWakeCond.notify_one();
+}
+
+void CommandQueue::workerMain(GLContext *ctx) {
+    gIsWorkerThread = true;
+    vglContextMakeCurrent(ctx);
+
+    while (true) {
+        CqBatch batch;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeCond.wait(lock, [this] { return mIsStopping || !mPendingBatches.empty(); });
+            if (mPendingBatches.empty()) {
+                break;
+            }
+            batch = std::move(mPendingBatches.front());
+            mPendingBatches.pop_front();
+        }
+
+        for (size_t offset = 0; offset < batch.size; ) {
+            const CqCommandHeader &header = *reinterpret_cast<const CqCommandHeader*>(&batch.data[offset]);
+            header.func(&batch.data[offset + sizeof(header)]);
+            offset += sizeof(header) + header.size;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            batch.size = 0;
+            mFreeBatches.push_back(std::move(batch));
+            mExecutedCount++;
+        }
+        mDoneCond.notify_all();
+    }
+
+    vglContextMakeCurrent(nullptr);
+}
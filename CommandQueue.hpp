@@ -0,0 +1,120 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+struct GLContext;
+
+// Recorded commands are submitted to the worker in batches of about this size, so it starts
+// executing a long frame before the frame is flushed
+constexpr size_t CQ_BATCH_SIZE = 256*1024;
+// Submitted batches which the worker hasn't executed yet. Recording waits when there are more,
+// so it runs only a few batches ahead of the worker
+constexpr size_t CQ_MAX_PENDING_BATCHES = 4;
+
+// Executes a command, data points to its arguments
+using CqExecuteFunc = void(*)(const uint8_t *data);
+
+// Header of every recorded command, its arguments follow it
+struct CqCommandHeader {
+    CqExecuteFunc func;
+    uint32_t size; // of the arguments, a multiple of 8
+};
+
+// Arguments of a command recorded by CommandQueue::recordCall. The called function is a template argument,
+// so execute is its own function for every one of them and the header's pointer is the only one recorded
+template <auto Func, typename... Params>
+struct CqCall {
+    std::tuple<Params...> args;
+
+    static void execute(const uint8_t *data) {
+        if constexpr (sizeof...(Params) == 0) {
+            Func();
+        }
+        else {
+            std::apply(Func, reinterpret_cast<const CqCall*>(data)->args);
+        }
+    }
+};
+
+// Recorded commands. The memory isn't initialized, only the size bytes of commands are written
+struct CqBatch {
+    std::unique_ptr<uint8_t[]> data;
+    size_t capacity = 0;
+    size_t size = 0;
+};
+
+// Deferred execution of the GL calls of a context. Calls are recorded into a byte buffer as a header
+// followed by the arguments, and the batches of commands are executed in order by a worker thread, which
+// has the context current. Commands are recorded by one thread, the one with the context current
+class CommandQueue {
+public:
+    CommandQueue() = default;
+    ~CommandQueue();
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue &operator=(const CommandQueue&) = delete;
+
+    // Starts the worker of ctx, or executes the recorded commands and stops it
+    void setEnabled(GLContext *ctx, bool isEnabled);
+    bool isEnabled() const;
+
+    // Whether the calls of this thread are recorded, which is false on the worker executing them
+    bool isRecording() const;
+
+    // Records a command executed by func and returns the space for its size bytes of arguments, aligned to 8 bytes.
+    // The space is valid until the next command is recorded
+    uint8_t *allocate(CqExecuteFunc func, size_t size);
+
+    // Records a call of Func, the arguments are copied so they must not point to anything
+    template <auto Func, typename... Args>
+    void recordCall(Args... args) {
+        recordCallOf<Func>(Func, args...);
+    }
+
+    // Submits the recorded commands and returns a fence which is signaled when the worker has executed them.
+    // Fences are numbered in submission order, so waiting for one waits for all the earlier ones as well
+    uint64_t flush();
+    bool isSignaled(uint64_t fence);
+    void wait(uint64_t fence);
+
+    void finish() {
+        wait(flush());
+    }
+
+private:
+    template <auto Func, typename... Params, typename... Args>
+    void recordCallOf(void (*)(Params...), Args... args) {
+        using Call = CqCall<Func, Params...>;
+        static_assert(((std::is_trivially_copyable_v<Params> && !std::is_pointer_v<Params>) && ...), "Arguments must be copyable values");
+        static_assert(std::is_trivially_destructible_v<Call> && alignof(Call) <= 8, "Commands are never destroyed and aligned to 8 bytes");
+        if constexpr (sizeof...(Params) == 0) {
+            allocate(&Call::execute, 0);
+        }
+        else {
+            new (allocate(&Call::execute, sizeof(Call))) Call{ std::tuple<Params...>(args...) };
+        }
+    }
+
+    void submit();
+    void workerMain(GLContext *ctx);
+
+    std::thread mWorker;
+    std::mutex mMutex;
+    std::condition_variable mWakeCond; // a batch was submitted or the worker is stopping
+    std::condition_variable mDoneCond; // a batch was executed
+    bool mIsStopping = false;
+
+    CqBatch mRecording;
+    std::deque<CqBatch> mPendingBatches;
+    std::vector<CqBatch> mFreeBatches; // executed ones, their memory is reused for recording
+    uint64_t mSubmittedCount = 0; // fence of the last submitted batch
+    uint64_t mExecutedCount = 0;
+};
@@ -1,19 +1,55 @@
 #include "GLInternal.hpp"
 #include "Rasterizer.hpp"
+#include "VertexProcessor.hpp"
+#include "VGLInternal.hpp"
+#include <algorithm>
+#include <cstring>
 
-GLState *gCurrentState = nullptr;
+thread_local GLState *gCurrentState = nullptr;
+
+// In the deferred mode (see vglContextSetDeferred) calls are recorded with their arguments and executed later by
+// the context's worker, which calls the same functions again. Returns true if the call was recorded
+template <auto Func, typename... Args>
+static bool deferCall(Args... args) {
+    CommandQueue &queue = gCurrentContext->commandQueue;
+    if (!queue.isRecording()) {
+        return false;
+    }
+    queue.recordCall<Func>(args...);
+    return true;
+}
+
+// Calls which return something wait until the worker has executed the recorded ones, and then run right here
+static void finishDeferred() {
+    gCurrentContext->commandQueue.finish();
+}
+
+// Display lists only record geometry, so the other commands which GL would record are ignored between
+// glNewList(GL_COMPILE) and glEndList rather than executed (see GL.hpp)
+static bool isCompileOnly() {
+    return gCurrentContext->compileMode == GL_COMPILE;
+}
 
 // ############################################################################################
 
 GLAPI void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+    if (deferCall<glClearColor>(red, green, blue, alpha) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->clearColor.setFloat4(red, green, blue, alpha);
 }
 
 GLAPI void glClearDepth(GLclampd depth) {
+    if (deferCall<glClearDepth>(depth) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->clearDepth = static_cast<float>(depth);
 }
 
 GLAPI void glClear(GLbitfield mask) {
+    if (deferCall<glClear>(mask) || isCompileOnly()) {
+        return;
+    }
     if (mask & GL_COLOR_BUFFER_BIT) {
         rsClearColor(gCurrentState->clearColor);
     }
@@ -25,59 +61,207 @@ GLAPI void glClear(GLbitfield mask) {
 // ############################################################################################
 
 GLAPI void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (deferCall<glViewport>(x, y, width, height) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->viewport.set(x, y, width, height);
 }
 
+static uint32_t getCapBit(GLenum cap) {
+    switch (cap) {
+        case GL_DEPTH_TEST: return GL_CAP_DEPTH_TEST;
+        case GL_CULL_FACE: return GL_CAP_CULL_FACE;
+        case GL_BLEND: return GL_CAP_BLEND;
+        case GL_TEXTURE_2D: return GL_CAP_TEXTURE_2D;
+        default: return 0;
+    }
+}
+
 GLAPI void glEnable(GLenum cap) {
-    gCurrentState->caps |= cap;
+    if (deferCall<glEnable>(cap) || isCompileOnly()) {
+        return;
+    }
+    gCurrentState->caps |= getCapBit(cap);
 }
 
 GLAPI void glDisable(GLenum cap) {
-    gCurrentState->caps &= ~cap;
+    if (deferCall<glDisable>(cap) || isCompileOnly()) {
+        return;
+    }
+    gCurrentState->caps &= ~getCapBit(cap);
+}
+
+GLAPI void glCullFace(GLenum mode) {
+    if (deferCall<glCullFace>(mode) || isCompileOnly()) {
+        return;
+    }
+    if (mode == GL_FRONT || mode == GL_BACK || mode == GL_FRONT_AND_BACK) {
+        gCurrentState->cullFace = mode;
+    }
+}
+
+GLAPI void glFrontFace(GLenum mode) {
+    if (deferCall<glFrontFace>(mode) || isCompileOnly()) {
+        return;
+    }
+    if (mode == GL_CW || mode == GL_CCW) {
+        gCurrentState->frontFace = mode;
+    }
 }
 
 GLAPI void glDepthFunc(GLenum func) {
+    if (deferCall<glDepthFunc>(func) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->depthFunc = func;
 }
 
+GLAPI void glDepthMask(GLboolean flag) {
+    if (deferCall<glDepthMask>(flag) || isCompileOnly()) {
+        return;
+    }
+    gCurrentState->depthWrite = flag != GL_FALSE;
+}
+
+GLAPI void glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+    if (deferCall<glColorMask>(red, green, blue, alpha) || isCompileOnly()) {
+        return;
+    }
+    Color mask;
+    mask.r = red ? 0xFF : 0;
+    mask.g = green ? 0xFF : 0;
+    mask.b = blue ? 0xFF : 0;
+    mask.a = alpha ? 0xFF : 0;
+    gCurrentState->colorMask = mask.rgba;
+}
+
+static bool isBlendFactor(GLenum factor) {
+    return factor == GL_ZERO || factor == GL_ONE || (factor >= GL_SRC_COLOR && factor <= GL_ONE_MINUS_DST_COLOR);
+}
+
+GLAPI void glBlendFunc(GLenum sfactor, GLenum dfactor) {
+    if (deferCall<glBlendFunc>(sfactor, dfactor) || isCompileOnly()) {
+        return;
+    }
+    // GL_SRC_ALPHA_SATURATE is a source factor only
+    if ((isBlendFactor(sfactor) || sfactor == GL_SRC_ALPHA_SATURATE) && isBlendFactor(dfactor)) {
+        gCurrentState->blendSrcFactor = sfactor;
+        gCurrentState->blendDstFactor = dfactor;
+    }
+}
+
+GLAPI void glBlendEquation(GLenum mode) {
+    if (deferCall<glBlendEquation>(mode) || isCompileOnly()) {
+        return;
+    }
+    switch (mode) {
+        case GL_FUNC_ADD:
+        case GL_FUNC_SUBTRACT:
+        case GL_FUNC_REVERSE_SUBTRACT:
+        case GL_MIN:
+        case GL_MAX:
+            gCurrentState->blendEquation = mode;
+            break;
+        default:
+            break;
+    }
+}
+
 // ############################################################################################
 
 GLAPI void glMatrixMode(GLenum mode) {
+    if (deferCall<glMatrixMode>(mode) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->matrixMode = mode;
 }
 
 GLAPI void glLoadIdentity(void) {
+    if (deferCall<glLoadIdentity>() || isCompileOnly()) {
+        return;
+    }
     gCurrentState->currentMat().setIdentity();
 }
 
+// Matrix passed by value, so a deferred glLoadMatrixf keeps its own copy
+struct GLMatrixArg {
+    GLfloat m[16];
+};
+
+static void loadMatrix(GLMatrixArg matrix) {
+    glLoadMatrixf(matrix.m);
+}
+
 GLAPI void glLoadMatrixf(const GLfloat *m) {
+    if (gCurrentContext->commandQueue.isRecording()) {
+        GLMatrixArg matrix;
+        std::copy(m, m + 16, matrix.m);
+        deferCall<loadMatrix>(matrix);
+        return;
+    }
+    if (isCompileOnly()) {
+        return;
+    }
     gCurrentState->currentMat().set(m);
 }
 
 GLAPI void glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+    if (deferCall<glRotatef>(angle, x, y, z) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->currentMat().rotate(angle, x, y, z);
 }
 
 GLAPI void glScalef(GLfloat x, GLfloat y, GLfloat z) {
+    if (deferCall<glScalef>(x, y, z) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->currentMat().scale(x, y, z);
 }
 
 GLAPI void glTranslatef(GLfloat x, GLfloat y, GLfloat z) {
+    if (deferCall<glTranslatef>(x, y, z) || isCompileOnly()) {
+        return;
+    }
     gCurrentState->currentMat().translate(x, y, z);
 }
 
 // ############################################################################################
 
+// The display list between glNewList and glEndList, if any
+static GLDisplayList *getCompiledList() {
+    return gCurrentContext->compiledListName ? &gCurrentContext->compiledList : nullptr;
+}
+
 GLAPI void glBegin(GLenum mode) {
+    if (deferCall<glBegin>(mode)) {
+        return;
+    }
     gCurrentState->primType = mode;
 }
 
 GLAPI void glColor3f(GLfloat red, GLfloat green, GLfloat blue) {
-    gCurrentState->imColor.setFloat4(red, green, blue, 1.0f);
+    glColor4f(red, green, blue, 1.0f);
 }
 
 GLAPI void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    if (deferCall<glColor4f>(red, green, blue, alpha)) {
+        return;
+    }
     gCurrentState->imColor.setFloat4(red, green, blue, alpha);
+    if (GLDisplayList *list = getCompiledList()) {
+        list->isColorSet = true;
+    }
+}
+
+GLAPI void glTexCoord2f(GLfloat s, GLfloat t) {
+    if (deferCall<glTexCoord2f>(s, t)) {
+        return;
+    }
+    gCurrentState->imTexCoord.set(s, t);
+    if (GLDisplayList *list = getCompiledList()) {
+        list->isTexCoordSet = true;
+    }
 }
 
 GLAPI void glVertex3f(GLfloat x, GLfloat y, GLfloat z) {
@@ -85,9 +269,23 @@ GLAPI void glVertex3f(GLfloat x, GLfloat y, GLfloat z) {
 }
 
 GLAPI void glVertex4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+    if (deferCall<glVertex4f>(x, y, z, w)) {
+        return;
+    }
+    GLDisplayList *list = getCompiledList();
+    std::vector<uint8_t> &listFlags = gCurrentContext->compiledVertexFlags;
+    if (list) {
+        list->submittedCount++;
+        listFlags.push_back((list->isColorSet ? GL_LIST_COLOR_SET : 0) | (list->isTexCoordSet ? GL_LIST_TEXCOORD_SET : 0));
+    }
+    if (!isCompileOnly()) {
+        gCurrentContext->counters[GL_COUNTER_VERTICES_SUBMITTED]++;
+    }
+
     Vertex v;
     v.pos.set(x, y, z, 1.0f);
     v.color = gCurrentState->imColor;
+    v.texCoord = gCurrentState->imTexCoord;
     vpAddVertex(std::move(v));
 
     if (gCurrentState->primType == GL_QUADS) {
@@ -97,6 +295,10 @@ GLAPI void glVertex4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
             size_t vert5Idx = vpGetVertices().size() - 1;
             vpAddVertex(Vertex(vpGetVertices()[vert4Idx]));
             vpAddVertex(Vertex(vpGetVertices()[vert5Idx]));
+            if (list) {
+                listFlags.push_back(listFlags[vert4Idx]);
+                listFlags.push_back(listFlags[vert5Idx]);
+            }
         }
         else if (gCurrentState->imQuadVertsCounter == 4) {
             gCurrentState->imQuadVertsCounter = 0;
@@ -105,9 +307,744 @@ GLAPI void glVertex4f(GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
 }
 
 GLAPI void glEnd(void) {
+    if (deferCall<glEnd>()) {
+        return;
+    }
     if (gCurrentState->primType == GL_QUADS) {
         gCurrentState->primType = GL_TRIANGLES;
     }
+    if (GLDisplayList *list = getCompiledList()) {
+        std::vector<uint8_t> &flags = gCurrentContext->compiledVertexFlags;
+        if (gCurrentState->primType == GL_TRIANGLES) {
+            const std::vector<Vertex> &vertices = vpGetVertices();
+            list->vertices.insert(list->vertices.end(), vertices.begin(), vertices.end());
+            list->vertexFlags.insert(list->vertexFlags.end(), flags.begin(), flags.end());
+        }
+        flags.clear();
+        if (isCompileOnly()) {
+            vpClear();
+            gCurrentState->primType = 0;
+            return;
+        }
+    }
     vpProcess();
     gCurrentState->primType = 0;
 }
+
+// ############################################################################################
+// Client arrays are client state which only draws read, so their calls run right away in the deferred mode as well.
+// Deferred draws copy the array elements they use instead, the application may change them as soon as the draw returns
+
+static void setArrayPointer(GLArrayPointer &array, GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
+    const int typeSize = (type == GL_UNSIGNED_BYTE) ? sizeof(GLubyte) : sizeof(GLfloat);
+    array.size = size;
+    array.type = type;
+    array.stride = stride ? stride : size*typeSize;
+    array.pointer = static_cast<const uint8_t*>(pointer);
+}
+
+GLAPI void glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
+    if (size >= 2 && size <= 4 && type == GL_FLOAT) {
+        setArrayPointer(gCurrentState->vertexArray, size, type, stride, pointer);
+    }
+}
+
+GLAPI void glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
+    if ((size == 3 || size == 4) && (type == GL_FLOAT || type == GL_UNSIGNED_BYTE)) {
+        setArrayPointer(gCurrentState->colorArray, size, type, stride, pointer);
+    }
+}
+
+GLAPI void glTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
+    if (size >= 1 && size <= 4 && type == GL_FLOAT) {
+        setArrayPointer(gCurrentState->texCoordArray, size, type, stride, pointer);
+    }
+}
+
+static GLArrayPointer *getClientArray(GLenum array) {
+    switch (array) {
+        case GL_VERTEX_ARRAY: return &gCurrentState->vertexArray;
+        case GL_COLOR_ARRAY: return &gCurrentState->colorArray;
+        case GL_TEXTURE_COORD_ARRAY: return &gCurrentState->texCoordArray;
+        default: return nullptr;
+    }
+}
+
+GLAPI void glEnableClientState(GLenum array) {
+    if (GLArrayPointer *clientArray = getClientArray(array)) {
+        clientArray->isEnabled = true;
+    }
+}
+
+GLAPI void glDisableClientState(GLenum array) {
+    if (GLArrayPointer *clientArray = getClientArray(array)) {
+        clientArray->isEnabled = false;
+    }
+}
+
+// Deferred draw, followed by the indices and the elements of the enabled arrays
+struct GLDrawCommand {
+    GLenum mode;
+    GLsizei count;
+    uint32_t indicesOffset; // from the command, 0 without indices
+    GLArrayPointer arrays[3]; // vertex, color and texture coordinates, without the pointers
+    uint32_t arrayOffsets[3];
+};
+
+static void executeDraw(const uint8_t *data) {
+    if (gCurrentState->primType != 0 || isCompileOnly()) {
+        return;
+    }
+    const GLDrawCommand &command = *reinterpret_cast<const GLDrawCommand*>(data);
+    GLArrayPointer arrays[3];
+    for (int i = 0; i < 3; i++) {
+        arrays[i] = command.arrays[i];
+        arrays[i].pointer = data + command.arrayOffsets[i];
+    }
+    const void *indices = command.indicesOffset ? data + command.indicesOffset : nullptr;
+    vpProcessArrays(arrays[0], arrays[1], arrays[2], command.mode, 0, command.count, GL_UNSIGNED_INT, indices);
+}
+
+static uint32_t alignCommandOffset(size_t offset) {
+    return static_cast<uint32_t>((offset + 3) & ~static_cast<size_t>(3));
+}
+
+// Copies the elements from the lowest to the highest index the draw uses, tightly packed. Indices are rebased to
+// the copy and made 32-bit. The base is a multiple of the vertex cache size, so the cache hits stay the same
+static void recordDraw(GLenum mode, GLint first, GLsizei count, GLenum indexType, const GLvoid *indices) {
+    uint32_t minIdx = first;
+    uint32_t maxIdx = first + count - 1;
+    uint32_t baseIdx = first;
+    if (indices) {
+        minIdx = UINT32_MAX;
+        maxIdx = 0;
+        for (GLsizei i = 0; i < count; i++) {
+            const uint32_t idx = vpFetchIndex(indexType, indices, i);
+            minIdx = std::min(minIdx, idx);
+            maxIdx = std::max(maxIdx, idx);
+        }
+        baseIdx = minIdx & ~(VP_VERTEX_CACHE_SIZE - 1);
+    }
+
+    const GLArrayPointer *arrays[3] = { &gCurrentState->vertexArray, &gCurrentState->colorArray, &gCurrentState->texCoordArray };
+    GLDrawCommand command;
+    command.mode = mode;
+    command.count = count;
+    size_t size = alignCommandOffset(sizeof(command));
+    command.indicesOffset = indices ? static_cast<uint32_t>(size) : 0;
+    if (indices) {
+        size += count*sizeof(uint32_t);
+    }
+    for (int i = 0; i < 3; i++) {
+        command.arrays[i] = *arrays[i];
+        command.arrays[i].pointer = nullptr;
+        command.arrays[i].stride = arrays[i]->size*static_cast<int>((arrays[i]->type == GL_UNSIGNED_BYTE) ? sizeof(GLubyte) : sizeof(GLfloat));
+        command.arrayOffsets[i] = 0;
+        if (arrays[i]->isEnabled) {
+            command.arrayOffsets[i] = alignCommandOffset(size);
+            size = command.arrayOffsets[i] + static_cast<size_t>(maxIdx - baseIdx + 1)*command.arrays[i].stride;
+        }
+    }
+
+    uint8_t *data = gCurrentContext->commandQueue.allocate(executeDraw, size);
+    memcpy(data, &command, sizeof(command));
+    if (indices) {
+        uint32_t *dstIndices = reinterpret_cast<uint32_t*>(data + command.indicesOffset);
+        for (GLsizei i = 0; i < count; i++) {
+            dstIndices[i] = vpFetchIndex(indexType, indices, i) - baseIdx;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (!arrays[i]->isEnabled) {
+            continue;
+        }
+        const int elementSize = command.arrays[i].stride;
+        uint8_t *dst = data + command.arrayOffsets[i] + static_cast<size_t>(minIdx - baseIdx)*elementSize;
+        for (uint32_t idx = minIdx; idx <= maxIdx; idx++, dst += elementSize) {
+            memcpy(dst, arrays[i]->getElement(idx), elementSize);
+        }
+    }
+}
+
+// Draws between glBegin and glEnd are ignored, in the deferred mode the worker checks it as glBegin is recorded too.
+// Same while compiling a display list
+GLAPI void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    if (!gCurrentState->vertexArray.isEnabled || first < 0 || count <= 0 || (mode != GL_TRIANGLES && mode != GL_QUADS)) {
+        return;
+    }
+    if (gCurrentContext->commandQueue.isRecording()) {
+        recordDraw(mode, first, count, GL_UNSIGNED_INT, nullptr);
+        return;
+    }
+    if (gCurrentState->primType != 0 || isCompileOnly()) {
+        return;
+    }
+    vpProcessArrays(gCurrentState->vertexArray, gCurrentState->colorArray, gCurrentState->texCoordArray, mode, first, count, GL_UNSIGNED_INT, nullptr);
+}
+
+GLAPI void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
+    if (!gCurrentState->vertexArray.isEnabled || count <= 0 || (mode != GL_TRIANGLES && mode != GL_QUADS)) {
+        return;
+    }
+    if (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT && type != GL_UNSIGNED_INT) {
+        return;
+    }
+    if (gCurrentContext->commandQueue.isRecording()) {
+        recordDraw(mode, 0, count, type, indices);
+        return;
+    }
+    if (gCurrentState->primType != 0 || isCompileOnly()) {
+        return;
+    }
+    vpProcessArrays(gCurrentState->vertexArray, gCurrentState->colorArray, gCurrentState->texCoordArray, mode, 0, count, type, indices);
+}
+
+// ############################################################################################
+
+static GLTexture *getTexture(GLuint id) {
+    auto &textures = gCurrentContext->textures;
+    if (id == 0 || id > textures.size() || !textures[id - 1].isUsed) {
+        return nullptr;
+    }
+    return &textures[id - 1];
+}
+
+static GLTexture *getBoundTexture(GLenum target) {
+    return (target == GL_TEXTURE_2D) ? getTexture(gCurrentState->boundTexture) : nullptr;
+}
+
+GLAPI void glGenTextures(GLsizei n, GLuint *textures) {
+    finishDeferred();
+    auto &objects = gCurrentContext->textures;
+    size_t freeIdx = 0;
+    for (GLsizei i = 0; i < n; i++) {
+        while (freeIdx < objects.size() && objects[freeIdx].isUsed) {
+            freeIdx++;
+        }
+        if (freeIdx == objects.size()) {
+            objects.emplace_back();
+        }
+        objects[freeIdx] = GLTexture();
+        objects[freeIdx].isUsed = true;
+        textures[i] = static_cast<GLuint>(freeIdx + 1);
+    }
+}
+
+GLAPI void glDeleteTextures(GLsizei n, const GLuint *textures) {
+    finishDeferred();
+    for (GLsizei i = 0; i < n; i++) {
+        GLTexture *texture = getTexture(textures[i]);
+        if (!texture) {
+            continue;
+        }
+        *texture = GLTexture(); // frees the texels
+        if (gCurrentState->boundTexture == textures[i]) {
+            gCurrentState->boundTexture = 0;
+        }
+    }
+}
+
+GLAPI GLboolean glIsTexture(GLuint texture) {
+    finishDeferred();
+    return getTexture(texture) ? GL_TRUE : GL_FALSE;
+}
+
+GLAPI void glBindTexture(GLenum target, GLuint texture) {
+    if (deferCall<glBindTexture>(target, texture) || isCompileOnly()) {
+        return;
+    }
+    if (target == GL_TEXTURE_2D && (texture == 0 || getTexture(texture))) {
+        gCurrentState->boundTexture = texture;
+    }
+}
+
+// Reads a texel of an RGB or RGBA image. Without alpha in the internal format the alpha is 1
+static Color fetchTexel(const uint8_t *src, GLenum format, bool hasAlpha) {
+    if (format == GL_RGB) {
+        return Color(src[0], src[1], src[2], 255);
+    }
+    return Color(src[0], src[1], src[2], hasAlpha ? src[3] : 255);
+}
+
+static bool isPixelFormatValid(GLenum format, GLenum type) {
+    return (format == GL_RGB || format == GL_RGBA) && type == GL_UNSIGNED_BYTE;
+}
+
+// Rows are aligned to 4 bytes, the default GL_UNPACK_ALIGNMENT
+static size_t getPixelsPitch(GLsizei width, GLenum format) {
+    const int texelSize = (format == GL_RGB) ? 3 : 4;
+    return (static_cast<size_t>(width)*texelSize + 3) & ~static_cast<size_t>(3);
+}
+
+// Deferred glTexImage2D, followed by a copy of the pixels
+struct GLTexImageCommand {
+    GLenum target;
+    GLint level, internalformat;
+    GLsizei width, height;
+    GLint border;
+    GLenum format, type;
+    bool hasPixels;
+};
+
+static void executeTexImage(const uint8_t *data) {
+    const GLTexImageCommand &command = *reinterpret_cast<const GLTexImageCommand*>(data);
+    glTexImage2D(command.target, command.level, command.internalformat, command.width, command.height, command.border,
+                 command.format, command.type, command.hasPixels ? data + sizeof(command) : nullptr);
+}
+
+static void recordTexImage(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border,
+                           GLenum format, GLenum type, const GLvoid *pixels) {
+    // Pixels of the calls which are going to fail are not copied
+    size_t pixelsSize = 0;
+    if (pixels && isPixelFormatValid(format, type) && width >= 0 && height >= 0 && width <= TEX_MAX_SIZE && height <= TEX_MAX_SIZE) {
+        pixelsSize = getPixelsPitch(width, format)*height;
+    }
+
+    const GLTexImageCommand command = { target, level, internalformat, width, height, border, format, type, pixels != nullptr };
+    uint8_t *data = gCurrentContext->commandQueue.allocate(executeTexImage, sizeof(command) + pixelsSize);
+    memcpy(data, &command, sizeof(command));
+    if (pixelsSize) {
+        memcpy(data + sizeof(command), pixels, pixelsSize);
+    }
+}
+
+GLAPI void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border,
+                        GLenum format, GLenum type, const GLvoid *pixels) {
+    if (gCurrentContext->commandQueue.isRecording()) {
+        recordTexImage(target, level, internalformat, width, height, border, format, type, pixels);
+        return;
+    }
+    if (isCompileOnly()) {
+        return;
+    }
+
+    GLTexture *texture = getBoundTexture(target);
+    const bool isFormatValid = isPixelFormatValid(format, type);
+    const bool hasAlpha = internalformat == GL_RGBA || internalformat == 4;
+    const bool isInternalFormatValid = hasAlpha || internalformat == GL_RGB || internalformat == 3;
+    if (!texture || !isFormatValid || !isInternalFormatValid || border != 0 || level < 0 || level >= TEX_MAX_LEVELS ||
+        width < 0 || height < 0 || width > (TEX_MAX_SIZE >> level) || height > (TEX_MAX_SIZE >> level)) {
+        return;
+    }
+
+    TextureImage &image = texture->image;
+    image.setLevelSize(level, Vec2i(width, height));
+    if (!pixels) {
+        return;
+    }
+
+    const int texelSize = (format == GL_RGB) ? 3 : 4;
+    const size_t pitch = getPixelsPitch(width, format);
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = static_cast<const uint8_t*>(pixels) + y*pitch;
+        for (int x = 0; x < width; x++) {
+            image.setTexel(level, x, y, fetchTexel(row + x*texelSize, format, hasAlpha));
+        }
+    }
+
+    if (level == 0 && texture->isGenerateMipmap) {
+        image.generateMipmaps();
+    }
+}
+
+static bool isTextureParamValid(GLenum pname, GLint param) {
+    switch (pname) {
+        case GL_TEXTURE_MIN_FILTER: return param == GL_NEAREST || param == GL_LINEAR || (param >= GL_NEAREST_MIPMAP_NEAREST && param <= GL_LINEAR_MIPMAP_LINEAR);
+        case GL_TEXTURE_MAG_FILTER: return param == GL_NEAREST || param == GL_LINEAR;
+        case GL_TEXTURE_WRAP_S:
+        case GL_TEXTURE_WRAP_T: return param == GL_REPEAT || param == GL_CLAMP_TO_EDGE;
+        case GL_GENERATE_MIPMAP: return param == GL_TRUE || param == GL_FALSE;
+        default: return false;
+    }
+}
+
+GLAPI void glTexParameteri(GLenum target, GLenum pname, GLint param) {
+    if (deferCall<glTexParameteri>(target, pname, param) || isCompileOnly()) {
+        return;
+    }
+    GLTexture *texture = getBoundTexture(target);
+    if (!texture || !isTextureParamValid(pname, param)) {
+        return;
+    }
+    switch (pname) {
+        case GL_TEXTURE_MIN_FILTER: texture->minFilter = param; break;
+        case GL_TEXTURE_MAG_FILTER: texture->magFilter = param; break;
+        case GL_TEXTURE_WRAP_S: texture->wrapS = param; break;
+        case GL_TEXTURE_WRAP_T: texture->wrapT = param; break;
+        default: texture->isGenerateMipmap = param == GL_TRUE; break;
+    }
+}
+
+GLAPI void glGenerateMipmap(GLenum target) {
+    if (deferCall<glGenerateMipmap>(target) || isCompileOnly()) {
+        return;
+    }
+    if (GLTexture *texture = getBoundTexture(target)) {
+        texture->image.generateMipmaps();
+    }
+}
+
+// ############################################################################################
+// Display lists keep the triangles of their glBegin/glEnd pairs in one vertex buffer, so glCallList
+// transforms and rasterizes all of them at once, without the per vertex calls
+
+// Appends the vertices of list, the attributes which it doesn't set itself are taken from the current ones if
+// the currentFlags attributes are defined. The flags of the appended vertices go to vertexFlags, if not null
+static void appendListVertices(const GLDisplayList &list, uint8_t currentFlags, std::vector<Vertex> &vertices,
+                               std::vector<uint8_t> *vertexFlags) {
+    for (size_t i = 0; i < list.vertices.size(); i++) {
+        Vertex v = list.vertices[i];
+        const uint8_t flags = list.vertexFlags[i];
+        if (!(flags & GL_LIST_COLOR_SET) && (currentFlags & GL_LIST_COLOR_SET)) {
+            v.color = gCurrentState->imColor;
+        }
+        if (!(flags & GL_LIST_TEXCOORD_SET) && (currentFlags & GL_LIST_TEXCOORD_SET)) {
+            v.texCoord = gCurrentState->imTexCoord;
+        }
+        vertices.push_back(v);
+        if (vertexFlags) {
+            vertexFlags->push_back(flags | currentFlags);
+        }
+    }
+}
+
+static GLDisplayList *getDisplayList(GLuint list) {
+    auto &lists = gCurrentContext->displayLists;
+    const auto it = lists.find(list);
+    return it != lists.end() ? &it->second : nullptr;
+}
+
+// Reserves a name given to glNewList, unless a generated span already has it
+static void reserveListName(GLuint name) {
+    auto &spans = gCurrentContext->reservedListNames;
+    auto it = spans.upper_bound(name);
+    if (it != spans.begin() && name - std::prev(it)->first < std::prev(it)->second) {
+        return;
+    }
+    spans.emplace(name, 1);
+}
+
+// Frees the names from first to end - 1, splitting the spans which reach out of them
+static void releaseListNames(uint64_t first, uint64_t end) {
+    auto &spans = gCurrentContext->reservedListNames;
+    auto it = spans.upper_bound(static_cast<GLuint>(first));
+    if (it != spans.begin()) {
+        it = std::prev(it);
+    }
+    while (it != spans.end() && it->first < end) {
+        const uint64_t spanFirst = it->first;
+        const uint64_t spanEnd = spanFirst + it->second;
+        if (spanEnd <= first) {
+            ++it;
+            continue;
+        }
+        it = spans.erase(it);
+        if (spanFirst < first) {
+            spans.emplace(static_cast<GLuint>(spanFirst), static_cast<GLuint>(first - spanFirst));
+        }
+        if (spanEnd > end) {
+            spans.emplace(static_cast<GLuint>(end), static_cast<GLuint>(spanEnd - end));
+        }
+    }
+}
+
+GLAPI GLuint glGenLists(GLsizei range) {
+    finishDeferred();
+    if (range <= 0) {
+        return 0;
+    }
+
+    // First gap of range names between the reserved spans
+    auto &spans = gCurrentContext->reservedListNames;
+    const auto count = static_cast<uint64_t>(range);
+    uint64_t first = 1;
+    for (const auto &span : spans) {
+        if (span.first - first >= count) {
+            break;
+        }
+        first = static_cast<uint64_t>(span.first) + span.second;
+    }
+    if (first + count - 1 > UINT32_MAX) {
+        return 0;
+    }
+    spans.emplace(static_cast<GLuint>(first), static_cast<GLuint>(count));
+    return static_cast<GLuint>(first);
+}
+
+GLAPI void glDeleteLists(GLuint list, GLsizei range) {
+    if (deferCall<glDeleteLists>(list, range)) {
+        return;
+    }
+    if (range <= 0) {
+        return;
+    }
+    const uint64_t end = std::min(static_cast<uint64_t>(list) + static_cast<uint64_t>(range), static_cast<uint64_t>(UINT32_MAX) + 1);
+    releaseListNames(list, end);
+
+    // Most names of a large range are unused, so the existing lists are walked instead
+    auto &lists = gCurrentContext->displayLists;
+    if (end - list > lists.size()) {
+        for (auto it = lists.begin(); it != lists.end(); ) {
+            it = (it->first >= list && it->first < end) ? lists.erase(it) : std::next(it);
+        }
+        return;
+    }
+    for (uint64_t name = list; name < end; name++) {
+        lists.erase(static_cast<GLuint>(name));
+    }
+}
+
+GLAPI GLboolean glIsList(GLuint list) {
+    finishDeferred();
+    return getDisplayList(list) ? GL_TRUE : GL_FALSE;
+}
+
+GLAPI void glNewList(GLuint list, GLenum mode) {
+    if (deferCall<glNewList>(list, mode)) {
+        return;
+    }
+    if (list == 0 || (mode != GL_COMPILE && mode != GL_COMPILE_AND_EXECUTE) || gCurrentContext->compiledListName != 0 ||
+        gCurrentState->primType != 0) {
+        return;
+    }
+    reserveListName(list);
+    gCurrentContext->compiledListName = list;
+    gCurrentContext->compileMode = mode;
+    gCurrentContext->compiledList = GLDisplayList();
+    gCurrentContext->compiledVertexFlags.clear();
+    gCurrentContext->compileStartColor = gCurrentState->imColor;
+    gCurrentContext->compileStartTexCoord = gCurrentState->imTexCoord;
+}
+
+GLAPI void glEndList(void) {
+    if (deferCall<glEndList>()) {
+        return;
+    }
+    if (gCurrentContext->compiledListName == 0 || gCurrentState->primType != 0) {
+        return;
+    }
+
+    GLDisplayList &compiledList = gCurrentContext->compiledList;
+    compiledList.color = gCurrentState->imColor;
+    compiledList.texCoord = gCurrentState->imTexCoord;
+    compiledList.hasUnsetAttribs = std::any_of(compiledList.vertexFlags.begin(), compiledList.vertexFlags.end(),
+                                               [](uint8_t flags) { return flags != GL_LIST_ATTRIBS_SET; });
+    if (isCompileOnly()) {
+        // The recorded commands were not executed
+        gCurrentState->imColor = gCurrentContext->compileStartColor;
+        gCurrentState->imTexCoord = gCurrentContext->compileStartTexCoord;
+    }
+
+    reserveListName(gCurrentContext->compiledListName); // again, if glDeleteLists freed it while compiling
+    gCurrentContext->displayLists[gCurrentContext->compiledListName] = std::move(compiledList);
+    compiledList = GLDisplayList();
+    gCurrentContext->compiledListName = 0;
+    gCurrentContext->compileMode = 0;
+}
+
+GLAPI void glCallList(GLuint list) {
+    if (deferCall<glCallList>(list)) {
+        return;
+    }
+    const GLDisplayList *displayList = getDisplayList(list);
+    if (!displayList || gCurrentState->primType != 0) {
+        return;
+    }
+
+    // Calls while compiling copy the called list's contents, completed with the attributes the compiled list has set
+    if (GLDisplayList *compiledList = getCompiledList()) {
+        const uint8_t currentFlags = (compiledList->isColorSet ? GL_LIST_COLOR_SET : 0) |
+                                     (compiledList->isTexCoordSet ? GL_LIST_TEXCOORD_SET : 0);
+        appendListVertices(*displayList, currentFlags, compiledList->vertices, &compiledList->vertexFlags);
+        compiledList->submittedCount += displayList->submittedCount;
+        compiledList->isColorSet |= displayList->isColorSet;
+        compiledList->isTexCoordSet |= displayList->isTexCoordSet;
+    }
+    if (!isCompileOnly()) {
+        gCurrentContext->counters[GL_COUNTER_VERTICES_SUBMITTED] += displayList->submittedCount;
+        if (displayList->hasUnsetAttribs) {
+            std::vector<Vertex> &vertices = gCurrentContext->calledListVertices;
+            vertices.clear();
+            appendListVertices(*displayList, GL_LIST_ATTRIBS_SET, vertices, nullptr);
+            vpProcessVertices(vertices);
+        }
+        else if (!displayList->vertices.empty()) {
+            vpProcessVertices(displayList->vertices);
+        }
+    }
+
+    if (displayList->isColorSet) {
+        gCurrentState->imColor = displayList->color;
+    }
+    if (displayList->isTexCoordSet) {
+        gCurrentState->imTexCoord = displayList->texCoord;
+    }
+}
+
+// ############################################################################################
+// Drawing is synchronous, so query results are available as soon as the query ends. In the deferred mode
+// they are read after the worker has executed the commands recorded before
+
+static uint64_t getTimestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int getQuerySlot(GLenum target) {
+    switch (target) {
+        case GL_SAMPLES_PASSED: return GL_QUERY_SLOT_SAMPLES_PASSED;
+        case GL_ANY_SAMPLES_PASSED: return GL_QUERY_SLOT_ANY_SAMPLES_PASSED;
+        case GL_TIME_ELAPSED: return GL_QUERY_SLOT_TIME_ELAPSED;
+        default: return -1;
+    }
+}
+
+static GLQuery *getQuery(GLuint id) {
+    auto &queries = gCurrentContext->queries;
+    if (id == 0 || id > queries.size() || !queries[id - 1].isUsed) {
+        return nullptr;
+    }
+    return &queries[id - 1];
+}
+
+static bool isQueryActive(GLuint id) {
+    return std::find(std::begin(gCurrentContext->activeQueries), std::end(gCurrentContext->activeQueries), id) !=
+           std::end(gCurrentContext->activeQueries);
+}
+
+GLAPI void glGenQueries(GLsizei n, GLuint *ids) {
+    finishDeferred();
+    auto &queries = gCurrentContext->queries;
+    size_t freeIdx = 0;
+    for (GLsizei i = 0; i < n; i++) {
+        while (freeIdx < queries.size() && queries[freeIdx].isUsed) {
+            freeIdx++;
+        }
+        if (freeIdx == queries.size()) {
+            queries.emplace_back();
+        }
+        queries[freeIdx] = GLQuery();
+        queries[freeIdx].isUsed = true;
+        ids[i] = static_cast<GLuint>(freeIdx + 1);
+    }
+}
+
+GLAPI void glDeleteQueries(GLsizei n, const GLuint *ids) {
+    finishDeferred();
+    for (GLsizei i = 0; i < n; i++) {
+        GLQuery *query = getQuery(ids[i]);
+        if (query && !isQueryActive(ids[i])) {
+            query->isUsed = false;
+        }
+    }
+}
+
+GLAPI GLboolean glIsQuery(GLuint id) {
+    finishDeferred();
+    return getQuery(id) ? GL_TRUE : GL_FALSE;
+}
+
+GLAPI void glBeginQuery(GLenum target, GLuint id) {
+    if (deferCall<glBeginQuery>(target, id) || isCompileOnly()) {
+        return;
+    }
+    const int slot = getQuerySlot(target);
+    GLQuery *query = getQuery(id);
+    if (slot < 0 || !query || gCurrentContext->activeQueries[slot] != 0 || isQueryActive(id) || (query->target && query->target != target)) {
+        return;
+    }
+
+    query->target = target;
+    query->start = (target == GL_TIME_ELAPSED) ? getTimestamp() : gCurrentContext->counters[GL_COUNTER_SAMPLES_PASSED];
+    gCurrentContext->activeQueries[slot] = id;
+}
+
+GLAPI void glEndQuery(GLenum target) {
+    if (deferCall<glEndQuery>(target) || isCompileOnly()) {
+        return;
+    }
+    const int slot = getQuerySlot(target);
+    if (slot < 0 || gCurrentContext->activeQueries[slot] == 0) {
+        return;
+    }
+
+    GLQuery *query = getQuery(gCurrentContext->activeQueries[slot]);
+    gCurrentContext->activeQueries[slot] = 0;
+    if (target == GL_TIME_ELAPSED) {
+        query->result = getTimestamp() - query->start;
+    }
+    else {
+        const uint64_t samplesPassed = gCurrentContext->counters[GL_COUNTER_SAMPLES_PASSED] - query->start;
+        query->result = (target == GL_ANY_SAMPLES_PASSED) ? (samplesPassed != 0) : samplesPassed;
+    }
+}
+
+GLAPI void glQueryCounter(GLuint id, GLenum target) {
+    if (deferCall<glQueryCounter>(id, target) || isCompileOnly()) {
+        return;
+    }
+    GLQuery *query = getQuery(id);
+    if (target != GL_TIMESTAMP || !query || isQueryActive(id) || (query->target && query->target != target)) {
+        return;
+    }
+    query->target = target;
+    query->result = getTimestamp();
+}
+
+static bool getQueryObject(GLuint id, GLenum pname, GLuint64 &value) {
+    const GLQuery *query = getQuery(id);
+    if (!query || isQueryActive(id)) {
+        return false;
+    }
+    switch (pname) {
+        case GL_QUERY_RESULT: value = query->result; return true;
+        case GL_QUERY_RESULT_AVAILABLE: value = GL_TRUE; return true;
+        default: return false;
+    }
+}
+
+GLAPI void glGetQueryObjectuiv(GLuint id, GLenum pname, GLuint *params) {
+    finishDeferred();
+    GLuint64 value;
+    if (getQueryObject(id, pname, value)) {
+        *params = static_cast<GLuint>(std::min<GLuint64>(value, UINT32_MAX)); // results which don't fit are clamped
+    }
+}
+
+GLAPI void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params) {
+    finishDeferred();
+    GLuint64 value;
+    if (getQueryObject(id, pname, value)) {
+        *params = value;
+    }
+}
+
+// ############################################################################################
+
+// The caller reads external buffers directly, so the pending fast clears and the multisampled colors are
+// written into them when the commands are flushed
+static void resolveExternalBuffers() {
+    GLContext *ctx = gCurrentContext;
+    rsResolveClears(ctx, (ctx->externalColorBuffer ? RS_CLEAR_COLOR : 0) | (ctx->externalDepthBuffer ? RS_CLEAR_DEPTH : 0));
+    if (ctx->externalColorBuffer && ctx->samplesCount > 1) {
+        rsResolveSamples(ctx);
+    }
+}
+
+static void flushExternalBuffers() {
+    if (!gCurrentContext->externalColorBuffer && !gCurrentContext->externalDepthBuffer) {
+        return;
+    }
+    if (!deferCall<resolveExternalBuffers>()) {
+        resolveExternalBuffers();
+    }
+}
+
+GLAPI void glFlush(void) {
+    flushExternalBuffers();
+    gCurrentContext->commandQueue.flush();
+}
+
+GLAPI void glFinish(void) {
+    flushExternalBuffers();
+    gCurrentContext->commandQueue.finish();
+}
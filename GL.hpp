@@ -22,10 +22,18 @@ typedef float GLfloat;
 typedef float GLclampf;
 typedef double GLdouble;
 typedef double GLclampd;
+typedef unsigned long long GLuint64;
 typedef void GLvoid;
 
 /*************************************************************/
 
+#define GL_FALSE                          0
+#define GL_TRUE                           1
+
+#define GL_ZERO                           0
+#define GL_NONE                           0
+#define GL_ONE                            1
+
  #define GL_NEVER                          0x0200
  #define GL_LESS                           0x0201
  #define GL_EQUAL                          0x0202
@@ -39,10 +47,77 @@ typedef void GLvoid;
 #define GL_COLOR_BUFFER_BIT               0x00004000
 
 #define GL_DEPTH_TEST                     0x0B71
+#define GL_CULL_FACE                      0x0B44
+#define GL_BLEND                          0x0BE2
+#define GL_TEXTURE_2D                     0x0DE1
+
+#define GL_SRC_COLOR                      0x0300
+#define GL_ONE_MINUS_SRC_COLOR            0x0301
+#define GL_SRC_ALPHA                      0x0302
+#define GL_ONE_MINUS_SRC_ALPHA            0x0303
+#define GL_DST_ALPHA                      0x0304
+#define GL_ONE_MINUS_DST_ALPHA            0x0305
+#define GL_DST_COLOR                      0x0306
+#define GL_ONE_MINUS_DST_COLOR            0x0307
+#define GL_SRC_ALPHA_SATURATE             0x0308
+
+#define GL_FUNC_ADD                       0x8006
+#define GL_MIN                            0x8007
+#define GL_MAX                            0x8008
+#define GL_FUNC_SUBTRACT                  0x800A
+#define GL_FUNC_REVERSE_SUBTRACT          0x800B
+
+#define GL_FRONT                          0x0404
+#define GL_BACK                           0x0405
+#define GL_FRONT_AND_BACK                 0x0408
+
+#define GL_CW                             0x0900
+#define GL_CCW                            0x0901
+
+#define GL_BYTE                           0x1400
+#define GL_UNSIGNED_BYTE                  0x1401
+#define GL_SHORT                          0x1402
+#define GL_UNSIGNED_SHORT                 0x1403
+#define GL_INT                            0x1404
+#define GL_UNSIGNED_INT                   0x1405
+#define GL_FLOAT                          0x1406
+
+#define GL_VERTEX_ARRAY                   0x8074
+#define GL_COLOR_ARRAY                    0x8076
+#define GL_TEXTURE_COORD_ARRAY            0x8078
+
+#define GL_RGB                            0x1907
+#define GL_RGBA                           0x1908
+
+#define GL_TEXTURE_MAG_FILTER             0x2800
+#define GL_TEXTURE_MIN_FILTER             0x2801
+#define GL_TEXTURE_WRAP_S                 0x2802
+#define GL_TEXTURE_WRAP_T                 0x2803
+
+#define GL_NEAREST                        0x2600
+#define GL_LINEAR                         0x2601
+#define GL_NEAREST_MIPMAP_NEAREST         0x2700
+#define GL_LINEAR_MIPMAP_NEAREST          0x2701
+#define GL_NEAREST_MIPMAP_LINEAR          0x2702
+#define GL_LINEAR_MIPMAP_LINEAR           0x2703
+
+#define GL_REPEAT                         0x2901
+#define GL_CLAMP_TO_EDGE                  0x812F
+#define GL_GENERATE_MIPMAP                0x8191
+
+#define GL_COMPILE                        0x1300
+#define GL_COMPILE_AND_EXECUTE            0x1301
 
 #define GL_MODELVIEW                      0x1700
 #define GL_PROJECTION                     0x1701
 
+#define GL_SAMPLES_PASSED                 0x8914
+#define GL_ANY_SAMPLES_PASSED             0x8C2F
+#define GL_TIME_ELAPSED                   0x88BF
+#define GL_TIMESTAMP                      0x8E28
+#define GL_QUERY_RESULT                   0x8866
+#define GL_QUERY_RESULT_AVAILABLE         0x8867
+
 //#define GL_POINTS                         0x0000
 //#define GL_LINES                          0x0001
 //#define GL_LINE_LOOP                      0x0002
@@ -64,6 +139,12 @@ GLAPI void APIENTRY glViewport (GLint x, GLint y, GLsizei width, GLsizei height)
 GLAPI void APIENTRY glEnable (GLenum cap);
 GLAPI void APIENTRY glDisable (GLenum cap);
 GLAPI void APIENTRY glDepthFunc (GLenum func);
+GLAPI void APIENTRY glDepthMask (GLboolean flag);
+GLAPI void APIENTRY glColorMask (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+GLAPI void APIENTRY glCullFace (GLenum mode);
+GLAPI void APIENTRY glFrontFace (GLenum mode);
+GLAPI void APIENTRY glBlendFunc (GLenum sfactor, GLenum dfactor);
+GLAPI void APIENTRY glBlendEquation (GLenum mode);
 
 GLAPI void APIENTRY glMatrixMode (GLenum mode);
 GLAPI void APIENTRY glLoadIdentity (void);
@@ -75,6 +156,45 @@ GLAPI void APIENTRY glTranslatef (GLfloat x, GLfloat y, GLfloat z);
 GLAPI void APIENTRY glBegin (GLenum mode);
 GLAPI void APIENTRY glColor3f (GLfloat red, GLfloat green, GLfloat blue);
 GLAPI void APIENTRY glColor4f (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+GLAPI void APIENTRY glTexCoord2f (GLfloat s, GLfloat t);
 GLAPI void APIENTRY glVertex3f (GLfloat x, GLfloat y, GLfloat z);
 GLAPI void APIENTRY glVertex4f (GLfloat x, GLfloat y, GLfloat z, GLfloat w);
 GLAPI void APIENTRY glEnd (void);
+
+GLAPI void APIENTRY glVertexPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
+GLAPI void APIENTRY glColorPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
+GLAPI void APIENTRY glTexCoordPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
+GLAPI void APIENTRY glEnableClientState (GLenum array);
+GLAPI void APIENTRY glDisableClientState (GLenum array);
+GLAPI void APIENTRY glDrawArrays (GLenum mode, GLint first, GLsizei count);
+GLAPI void APIENTRY glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
+
+GLAPI void APIENTRY glGenTextures (GLsizei n, GLuint *textures);
+GLAPI void APIENTRY glDeleteTextures (GLsizei n, const GLuint *textures);
+GLAPI GLboolean APIENTRY glIsTexture (GLuint texture);
+GLAPI void APIENTRY glBindTexture (GLenum target, GLuint texture);
+GLAPI void APIENTRY glTexImage2D (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels);
+GLAPI void APIENTRY glTexParameteri (GLenum target, GLenum pname, GLint param);
+GLAPI void APIENTRY glGenerateMipmap (GLenum target);
+
+// Display lists only record glBegin, glEnd, glVertex, glColor, glTexCoord and glCallList. Between glNewList with
+// GL_COMPILE and glEndList the other commands which GL would record (state, matrix, clear, draw, texture and query
+// commands) are ignored, with GL_COMPILE_AND_EXECUTE they are executed without being recorded
+GLAPI GLuint APIENTRY glGenLists (GLsizei range);
+GLAPI void APIENTRY glDeleteLists (GLuint list, GLsizei range);
+GLAPI GLboolean APIENTRY glIsList (GLuint list);
+GLAPI void APIENTRY glNewList (GLuint list, GLenum mode);
+GLAPI void APIENTRY glEndList (void);
+GLAPI void APIENTRY glCallList (GLuint list);
+
+GLAPI void APIENTRY glFlush (void);
+GLAPI void APIENTRY glFinish (void);
+
+GLAPI void APIENTRY glGenQueries (GLsizei n, GLuint *ids);
+GLAPI void APIENTRY glDeleteQueries (GLsizei n, const GLuint *ids);
+GLAPI GLboolean APIENTRY glIsQuery (GLuint id);
+GLAPI void APIENTRY glBeginQuery (GLenum target, GLuint id);
+GLAPI void APIENTRY glEndQuery (GLenum target);
+GLAPI void APIENTRY glQueryCounter (GLuint id, GLenum target);
+GLAPI void APIENTRY glGetQueryObjectuiv (GLuint id, GLenum pname, GLuint *params);
+GLAPI void APIENTRY glGetQueryObjectui64v (GLuint id, GLenum pname, GLuint64 *params);
@@ -2,6 +2,24 @@
 #include "GL.hpp"
 #include "Math.hpp"
 
+// Bits of GLState::caps, the GL_* capability values themselves overlap
+constexpr uint32_t GL_CAP_DEPTH_TEST = 1 << 0;
+constexpr uint32_t GL_CAP_CULL_FACE = 1 << 1;
+constexpr uint32_t GL_CAP_BLEND = 1 << 2;
+constexpr uint32_t GL_CAP_TEXTURE_2D = 1 << 3;
+
+struct GLArrayPointer {
+    bool isEnabled = false;
+    int size = 4;
+    uint32_t type = GL_FLOAT;
+    int stride = 0; // in bytes, already resolved for tightly packed arrays
+    const uint8_t *pointer = nullptr;
+
+    const uint8_t *getElement(uint32_t idx) const {
+        return this->pointer + static_cast<size_t>(idx)*this->stride;
+    }
+};
+
 struct GLState {
     Color clearColor = Color(0, 0, 0, 255);
     float clearDepth = 1.0f;
@@ -12,20 +30,31 @@ struct GLState {
 
     IntRect viewport = IntRect(0, 0, 0, 0);
     uint32_t depthFunc = GL_LESS;
-    uint32_t caps = 0;
+    bool depthWrite = true;
+    uint32_t colorMask = 0xFFFFFFFF; // 0xFF in the bytes of the writable channels
+    uint32_t cullFace = GL_BACK;
+    uint32_t frontFace = GL_CCW;
+    uint32_t blendSrcFactor = GL_ONE;
+    uint32_t blendDstFactor = GL_ZERO;
+    uint32_t blendEquation = GL_FUNC_ADD;
+    uint32_t caps = 0; // GL_CAP_* bits
+    uint32_t boundTexture = 0;
 
     Color imColor = Color(255, 255, 255, 255);
+    Vec2f imTexCoord = Vec2f(0.0f, 0.0f);
     uint32_t imQuadVertsCounter = 0;
     uint32_t primType = 0;
 
+    GLArrayPointer vertexArray;
+    GLArrayPointer colorArray;
+    GLArrayPointer texCoordArray;
+
     Mat4f &currentMat() {
         if (matrixMode == GL_PROJECTION) {
             return projMat;
         }
-        else if (matrixMode == GL_MODELVIEW) {
-            return modelViewMat;
-        }
+        return modelViewMat;
     }
 };
 
-extern GLState *gCurrentState;
+extern thread_local GLState *gCurrentState; // state of gCurrentContext
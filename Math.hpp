@@ -1,4 +1,5 @@
 #pragma once
+#include "Platform.hpp"
 #include <type_traits>
 #include <limits>
 #define _USE_MATH_DEFINES
@@ -97,11 +98,11 @@ struct Color {
     }
 
     bool operator==(const Color &rhs) const {
-        return this->data == rhs.data;
+        return this->rgba == rhs.rgba;
     }
 
     bool operator!=(const Color &rhs) const {
-        return this->data != rhs.data;
+        return this->rgba != rhs.rgba;
     }
 
     union {
@@ -244,8 +245,8 @@ struct Vec2 {
 using Vec2i = Vec2<int>;
 using Vec2f = Vec2<float>;
 
-using AlignedVec2i = __declspec(align(16)) Vec2<int>;
-using AlignedVec2f = __declspec(align(16)) Vec2<float>;
+VGL_ALIGNED_ALIAS(AlignedVec2i, 16, Vec2<int>);
+VGL_ALIGNED_ALIAS(AlignedVec2f, 16, Vec2<float>);
 
 // ##################################################################################
 // ### Vec3
@@ -389,8 +390,8 @@ struct Vec3 {
 using Vec3i = Vec3<int>;
 using Vec3f = Vec3<float>;
 
-using AlignedVec3i = __declspec(align(16)) Vec3<int>;
-using AlignedVec3f = __declspec(align(16)) Vec3<float>;
+VGL_ALIGNED_ALIAS(AlignedVec3i, 16, Vec3<int>);
+VGL_ALIGNED_ALIAS(AlignedVec3f, 16, Vec3<float>);
 
 // ##################################################################################
 // ### Vec4
@@ -548,8 +549,8 @@ struct Vec4 {
 using Vec4i = Vec4<int>;
 using Vec4f = Vec4<float>;
 
-using AlignedVec4i = __declspec(align(16)) Vec4<int>;
-using AlignedVec4f = __declspec(align(16)) Vec4<float>;
+VGL_ALIGNED_ALIAS(AlignedVec4i, 16, Vec4<int>);
+VGL_ALIGNED_ALIAS(AlignedVec4f, 16, Vec4<float>);
 
 // ##################################################################################
 // ### Rect
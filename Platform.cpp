@@ -0,0 +1,61 @@
+#include "Platform.hpp"
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#else
+#   include <cpuid.h>
+#endif
+
+static void cpuid(int leaf, int subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int i = 0; i < 4; i++) {
+        regs[i] = static_cast<uint32_t>(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XCR0, the register states the OS saves on context switches
+static uint64_t getEnabledXState() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static SimdLevel detectSimdLevel() {
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    const uint32_t maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    const bool hasSSE41 = (regs[2] >> 19) & 1;
+    const bool hasOSXSave = (regs[2] >> 27) & 1;
+    const bool hasAVX = (regs[2] >> 28) & 1;
+    if (!hasSSE41) {
+        return SIMD_SSE2;
+    }
+
+    // AVX registers are usable only when the OS saves both the XMM and the YMM state
+    if (maxLeaf >= 7 && hasOSXSave && hasAVX && (getEnabledXState() & 6) == 6) {
+        cpuid(7, 0, regs);
+        const bool hasAVX2 = (regs[1] >> 5) & 1;
+        if (hasAVX2) {
+            return SIMD_AVX2;
+        }
+    }
+    return SIMD_SSE41;
+}
+
+SimdLevel getSupportedSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+std::atomic<SimdLevel> gSimdLevel = getSupportedSimdLevel();
@@ -0,0 +1,40 @@
+#pragma once
+#include <immintrin.h>
+#include <atomic>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#   define VGL_FORCEINLINE __forceinline
+#   define VGL_FASTCALL __fastcall
+#   define VGL_ALIGNED_ALIAS(name, alignment, ...) using name = __declspec(align(alignment)) __VA_ARGS__
+#else
+#   define VGL_FORCEINLINE inline __attribute__((always_inline))
+#   define VGL_FASTCALL
+#   define VGL_ALIGNED_ALIAS(name, alignment, ...) using name __attribute__((aligned(alignment))) = __VA_ARGS__
+#endif
+
+// Functions using instructions above SSE2 are marked with these. GCC and Clang only allow the intrinsics
+// in functions targeting their instruction set, MSVC allows them everywhere
+#if defined(_MSC_VER)
+#   define VGL_TARGET_SSE2
+#   define VGL_TARGET_SSE41
+#   define VGL_TARGET_AVX2
+#else
+#   define VGL_TARGET_SSE2
+#   define VGL_TARGET_SSE41 __attribute__((target("sse4.1")))
+#   define VGL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Instruction sets of the SIMD kernels, every level includes the ones below it
+enum SimdLevel : int {
+    SIMD_SSE2,
+    SIMD_SSE41,
+    SIMD_AVX2,
+};
+
+// Best level the CPU and the OS support, detected once by CPUID
+SimdLevel getSupportedSimdLevel();
+
+// Level of the kernels in use, the supported one unless lowered by vglSetSimdLevel. Shared by all contexts,
+// which may be drawing on other threads when it changes
+extern std::atomic<SimdLevel> gSimdLevel;
@@ -1,215 +1,579 @@
 #include "Rasterizer.hpp"
+#include "RasterizerInternal.hpp"
+#include "Platform.hpp"
 #include "VGLInternal.hpp"
-#include <intrin.h>
+#include <algorithm>
+#include <cstring>
 
-static IntRect gBufferRect = IntRect(0, 0, 0, 0);
-static Color *gColorBuffer = nullptr;
-static float *gDepthBuffer = nullptr;
-
-static std::vector<Color> gColorClearData = { Color(0, 0, 0, 0) };
-static std::vector<float> gDepthClearData = { 1.0f };
+Vec2i rsGetHiZSize(const Vec2i &bufferSize) {
+    return Vec2i((bufferSize.x + RS_BLOCK_SIZE - 1) / RS_BLOCK_SIZE, (bufferSize.y + RS_BLOCK_SIZE - 1) / RS_BLOCK_SIZE);
+}
 
-void rsSetFramebuffer(const IntRect &rect, Color *colorBuffer, float *depthBuffer) {
-    gBufferRect = rect;
-    gColorBuffer = colorBuffer;
-    gDepthBuffer = depthBuffer;
+Vec2i rsGetTilesCount(const Vec2i &bufferSize) {
+    return Vec2i((bufferSize.x + RS_TILE_SIZE - 1) / RS_TILE_SIZE, (bufferSize.y + RS_TILE_SIZE - 1) / RS_TILE_SIZE);
+}
 
-    int area = rect.getArea();
-    gColorClearData.resize(area, gColorClearData.front());
-    gDepthClearData.resize(area, gDepthClearData.front());
+void rsSetFramebuffer(RsContext &rs, const IntRect &rect, Color *colorBuffer, int colorPitch, void *depthBuffer, RsDepthFormat depthFormat,
+                      DepthRange *hiZBuffer) {
+    rs.bufferRect = rect;
+    rs.colorBuffer = colorBuffer;
+    rs.colorPitch = colorPitch;
+    rs.depthBuffer = depthBuffer;
+    rs.depthFormat = depthFormat;
+    rs.hiZBuffer = hiZBuffer;
+    rs.hiZSize = rsGetHiZSize(rect.getSize());
+    rs.tilesCount = rsGetTilesCount(rect.getSize());
+    rs.tileBins.resize(rs.tilesCount.x*rs.tilesCount.y);
+    rs.depthSamples[0] = depthBuffer;
 }
 
-const IntRect &rsGetFramebufferRect() {
-    return gBufferRect;
+void rsSetSampleBuffers(RsContext &rs, Color *colorSamples, uint8_t *sampleFlags, void *depthSamples) {
+    const size_t planeSize = rs.bufferRect.getArea();
+    rs.isMultisample = colorSamples != nullptr;
+    rs.sampleFlags = sampleFlags;
+    for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+        rs.colorSamples[s] = colorSamples ? colorSamples + s*planeSize : nullptr;
+    }
+    for (int s = 1; s < RS_SAMPLES_COUNT; s++) {
+        rs.depthSamples[s] = depthSamples ? static_cast<uint8_t*>(depthSamples) + (s - 1)*planeSize*rsGetDepthFormatSize(rs.depthFormat) : nullptr;
+    }
 }
 
-void rsClearColor(const Color &color) {
-    if (gColorClearData.front() != color) {
-        std::fill(gColorClearData.begin(), gColorClearData.end(), color);
+// Fills size bytes with a pattern of 16 or 32-bit values using non-temporal stores. Cleared buffers are usually
+// larger than the cache and written again before they are read, so there is no point in reading them into the
+// cache first. The pattern must repeat every 2 bytes for 16-bit values. The caller issues the store fence
+static void fillStream(void *dst, uint32_t pattern, size_t size) {
+    uint8_t *ptr = static_cast<uint8_t*>(dst);
+    for (; size >= 2 && (reinterpret_cast<uintptr_t>(ptr) & 15); ) {
+        if ((reinterpret_cast<uintptr_t>(ptr) & 3) == 0 && size >= 4) {
+            memcpy(ptr, &pattern, 4);
+            ptr += 4;
+            size -= 4;
+        }
+        else {
+            memcpy(ptr, &pattern, 2);
+            ptr += 2;
+            size -= 2;
+        }
+    }
+
+    const __m128i v = _mm_set1_epi32(pattern);
+    for (; size >= 64; size -= 64, ptr += 64) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(ptr) + 0, v);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(ptr) + 1, v);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(ptr) + 2, v);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(ptr) + 3, v);
+    }
+    for (; size >= 16; size -= 16, ptr += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(ptr), v);
+    }
+    for (; size >= 4; size -= 4, ptr += 4) {
+        memcpy(ptr, &pattern, 4);
+    }
+    if (size >= 2) {
+        memcpy(ptr, &pattern, 2);
     }
-    memcpy(gColorBuffer, gColorClearData.data(), gColorClearData.size()*sizeof(Color));
 }
 
-void rsClearDepth(float depth) {
-    if (gDepthClearData.front() != depth) {
-        std::fill(gDepthClearData.begin(), gDepthClearData.end(), depth);
+// Fills count pixels of pixelSize bytes with value. Bytes are the sample flags, which are small enough for the cache
+static void fillPixels(void *dst, uint32_t value, int pixelSize, size_t count, bool isStreaming) {
+    if (pixelSize == 1) {
+        memset(dst, static_cast<int>(value), count);
+    }
+    else if (isStreaming) {
+        fillStream(dst, pixelSize == 2 ? (value & 0xFFFF)*0x10001u : value, count*pixelSize);
+    }
+    else if (pixelSize == 2) {
+        std::fill_n(static_cast<uint16_t*>(dst), count, static_cast<uint16_t>(value));
+    }
+    else {
+        std::fill_n(static_cast<uint32_t*>(dst), count, value);
     }
-    memcpy(gDepthBuffer, gDepthClearData.data(), gDepthClearData.size()*sizeof(float));
 }
 
-template<typename T>
-__forceinline bool __fastcall compareFunc(uint32_t func, T lhs, T rhs) {
-    switch (func) {
-        case GL_NEVER: {
-            return false;
-        }
-        case GL_LESS: {
-            return lhs < rhs;
+// Writes the pending clears of the tile selected by flags. Tiles which are about to be drawn into are
+// written with regular stores, so they stay in the cache for the rasterizer
+static void resolveTileClears(GLContext &ctx, uint32_t tileIdx, uint8_t flags, bool isStreaming) {
+    flags &= ctx.tileClearFlags[tileIdx];
+    if (!flags) {
+        return;
+    }
+    ctx.tileClearFlags[tileIdx] &= ~flags;
+
+    const auto bufferSize = ctx.bufferRect.getSize();
+    const auto tilesCount = rsGetTilesCount(bufferSize);
+    const auto tileMin = Vec2i(tileIdx % tilesCount.x, tileIdx / tilesCount.x)*RS_TILE_SIZE;
+    const auto tileMax = Vec2i::min(tileMin + Vec2i(RS_TILE_SIZE), bufferSize);
+    const size_t width = tileMax.x - tileMin.x;
+
+    const RsContext &rs = ctx.rasterizer;
+    const int depthSize = rsGetDepthFormatSize(rs.depthFormat);
+    struct Clear {
+        uint8_t flag;
+        uint8_t *buffer;
+        size_t pitch; // in bytes
+        int pixelSize;
+        uint32_t value;
+    } clears[2 + RS_SAMPLES_COUNT];
+    int clearsCount = 0;
+    if (rs.isMultisample) {
+        // Only the first color sample is written, the flags mark the others as equal to it
+        clears[clearsCount++] = { RS_CLEAR_COLOR, reinterpret_cast<uint8_t*>(rs.colorSamples[0]), bufferSize.x*sizeof(Color), sizeof(Color),
+                                  ctx.fastClearColor.rgba };
+        clears[clearsCount++] = { RS_CLEAR_COLOR, rs.sampleFlags, static_cast<size_t>(bufferSize.x), 1, 1 };
+        for (void *depthSamples : rs.depthSamples) {
+            clears[clearsCount++] = { RS_CLEAR_DEPTH, static_cast<uint8_t*>(depthSamples), static_cast<size_t>(bufferSize.x)*depthSize, depthSize,
+                                      ctx.fastClearDepth };
         }
-        case GL_EQUAL: {
-            return Math::isEqual(lhs, rhs);
+    }
+    else {
+        clears[clearsCount++] = { RS_CLEAR_COLOR, reinterpret_cast<uint8_t*>(rs.colorBuffer), rs.colorPitch*sizeof(Color), sizeof(Color),
+                                  ctx.fastClearColor.rgba };
+        clears[clearsCount++] = { RS_CLEAR_DEPTH, static_cast<uint8_t*>(rs.depthBuffer), static_cast<size_t>(bufferSize.x)*depthSize, depthSize,
+                                  ctx.fastClearDepth };
+    }
+    for (int i = 0; i < clearsCount; i++) {
+        const Clear &clear = clears[i];
+        if (!(flags & clear.flag)) {
+            continue;
         }
-        case GL_LEQUAL: {
-            return lhs <= rhs;
+        for (int y = tileMin.y; y < tileMax.y; y++) {
+            uint8_t *row = clear.buffer + y*clear.pitch + tileMin.x*clear.pixelSize;
+            fillPixels(row, clear.value, clear.pixelSize, width, isStreaming);
         }
-        case GL_GREATER: {
-            return lhs > rhs;
+    }
+}
+
+void rsResolveClears(GLContext *ctx, uint8_t flags) {
+    for (size_t i = 0; i < ctx->tileClearFlags.size(); i++) {
+        resolveTileClears(*ctx, static_cast<uint32_t>(i), flags, true);
+    }
+    _mm_sfence();
+}
+
+// Rounded average of the samples of 4 pixels per channel, exact in the 16-bit lanes
+static __m128i averageSamples(const __m128i samples[RS_SAMPLES_COUNT]) {
+    static_assert(RS_SAMPLES_COUNT == 4, "The sum is divided by a shift");
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_set1_epi16(RS_SAMPLES_COUNT / 2);
+    __m128i hi = lo;
+    for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(samples[s], zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(samples[s], zero));
+    }
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+}
+
+// Pixels with the flag set are copied from the first sample, so groups of them read nothing else
+static void resolveSampleRow(const RsContext &rs, int y) {
+    const int width = rs.bufferRect.getSize().x;
+    const size_t rowIdx = static_cast<size_t>(y)*width;
+    const uint8_t *flags = rs.sampleFlags + rowIdx;
+    Color *dst = rs.colorBuffer + static_cast<size_t>(y)*rs.colorPitch;
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        uint32_t groupFlags;
+        memcpy(&groupFlags, flags + x, sizeof(groupFlags));
+        __m128i samples[RS_SAMPLES_COUNT];
+        samples[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rs.colorSamples[0] + rowIdx + x));
+        if (groupFlags == 0x01010101) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), samples[0]);
+            continue;
         }
-        case GL_NOTEQUAL: {
-            return Math::isNotEqual(lhs, rhs);
+
+        for (int s = 1; s < RS_SAMPLES_COUNT; s++) {
+            samples[s] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rs.colorSamples[s] + rowIdx + x));
         }
-        case GL_GEQUAL: {
-            return lhs >= rhs;
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i flagLanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(groupFlags)), zero), zero);
+        const __m128i isEqual = _mm_cmpgt_epi32(flagLanes, zero);
+        const __m128i average = averageSamples(samples);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_or_si128(_mm_and_si128(isEqual, samples[0]), _mm_andnot_si128(isEqual, average)));
+    }
+    for (; x < width; x++) {
+        if (flags[x]) {
+            dst[x] = rs.colorSamples[0][rowIdx + x];
+            continue;
         }
-        case GL_ALWAYS: {
-            return true;
+        uint32_t rgba = 0;
+        for (int c = 0; c < 32; c += 8) {
+            uint32_t sum = RS_SAMPLES_COUNT / 2;
+            for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+                sum += (rs.colorSamples[s][rowIdx + x].rgba >> c) & 0xFF;
+            }
+            rgba |= (sum / RS_SAMPLES_COUNT) << c;
         }
+        dst[x].rgba = rgba;
     }
 }
 
-void drawTriangleBarycentric(const Vec2i &bufferSize, bool isDepthTest, uint32_t depthFunc, const Vec2i &vpMin, const Vec2i &vpMax,
-                             const Vertex &A, const Vertex &B, const Vertex &C) {
-    const Vec4f colorBCA[] = {
-        Vec4f(B.color.r, C.color.r, A.color.r, 0.0f),
-        Vec4f(B.color.g, C.color.g, A.color.g, 0.0f),
-        Vec4f(B.color.b, C.color.b, A.color.b, 0.0f),
-        Vec4f(B.color.a, C.color.a, A.color.a, 0.0f),
-    };
-
-    const auto triMin = Vec2i(Vec4f::min(A.pos, B.pos, C.pos));
-    const auto triMax = Vec2i(Vec4f::max(A.pos, B.pos, C.pos));
-    const auto min = Vec2i::clamp(triMin, vpMin, vpMax);
-    const auto max = Vec2i::clamp(triMax, vpMin, vpMax);
-
-    const auto invABCz = Vec4f(1.0f / A.pos.z, 1.0f / B.pos.z, 1.0f / C.pos.z, 0.0f);
+void rsResolveSamples(GLContext *ctx) {
+    const RsContext &rs = ctx->rasterizer;
+    const int height = rs.bufferRect.getSize().y;
+    const size_t bandsCount = (height + RS_TILE_SIZE - 1) / RS_TILE_SIZE;
+    ctx->threadPool.parallelFor(bandsCount, [&](size_t band) {
+        const int bandEnd = Math::min(static_cast<int>(band + 1)*RS_TILE_SIZE, height);
+        for (int y = static_cast<int>(band)*RS_TILE_SIZE; y < bandEnd; y++) {
+            resolveSampleRow(rs, y);
+        }
+    });
+}
 
-    const Vec4f AC = Vec4f(C.pos - A.pos);
-    const Vec4f AB = Vec4f(B.pos - A.pos);
+void rsClearColor(const Color &color) {
+    StageTimer timer(GL_STAGE_CLEAR);
+    GLContext &ctx = *gCurrentContext;
+    if (ctx.isFastClear) {
+        ctx.fastClearColor = color;
+        for (uint8_t &flags : ctx.tileClearFlags) {
+            flags |= RS_CLEAR_COLOR;
+        }
+        return;
+    }
 
-    const float bcW = AB.x*AC.y - AC.x*AB.y;
-    const float bcInvW = 1.0f / bcW;
+    const RsContext &rs = ctx.rasterizer;
+    if (rs.isMultisample) {
+        fillPixels(rs.colorSamples[0], color.rgba, sizeof(Color), rs.bufferRect.getArea(), true);
+        fillPixels(rs.sampleFlags, 1, 1, rs.bufferRect.getArea(), false);
+        _mm_sfence();
+        return;
+    }
 
-    for (int y = min.y; y <= max.y; y++) {
-        const int PAy = A.pos.y - y;
+    const Vec2i bufferSize = rs.bufferRect.getSize();
+    for (int y = 0; y < bufferSize.y; y++) {
+        fillPixels(rs.colorBuffer + static_cast<size_t>(y)*rs.colorPitch, color.rgba, sizeof(Color), bufferSize.x, true);
+    }
+    _mm_sfence();
+}
 
-        for (int x = min.x; x <= max.x; x++) {
-            const int PAx = A.pos.x - x;
+void rsClearDepth(float depth) {
+    StageTimer timer(GL_STAGE_CLEAR);
+    GLContext &ctx = *gCurrentContext;
+    RsContext &rs = ctx.rasterizer;
+
+    // The block ranges hold the stored value, which is rounded for the unorm formats
+    const uint32_t value = rsEncodeDepth(rs.depthFormat, depth);
+    const float storedDepth = (rs.depthFormat == RS_DEPTH_D32F) ? depth : static_cast<float>(value);
+    std::fill(rs.hiZBuffer, rs.hiZBuffer + rs.hiZSize.x*rs.hiZSize.y, DepthRange{ storedDepth, storedDepth });
+    if (ctx.isFastClear) {
+        ctx.fastClearDepth = value;
+        for (uint8_t &flags : ctx.tileClearFlags) {
+            flags |= RS_CLEAR_DEPTH;
+        }
+        return;
+    }
 
-            const float bcU = AC.x*PAy - PAx*AC.y;
-            const float bcV = PAx*AB.y - AB.x*PAy;
+    const int planesCount = rs.isMultisample ? RS_SAMPLES_COUNT : 1;
+    for (int s = 0; s < planesCount; s++) {
+        fillPixels(rs.depthSamples[s], value, rsGetDepthFormatSize(rs.depthFormat), rs.bufferRect.getArea(), true);
+    }
+    _mm_sfence();
+}
 
-            auto bcScreen = Vec4f(bcU, bcV, 0.0f, 0.0f);
-            bcScreen *= bcInvW;
-            bcScreen.z = 1.0f - bcScreen.x - bcScreen.y;
+// Windings dropped by the triangle setup, by the sign of the screen space area. Screen space y points
+// down, so triangles which are counter-clockwise in window coordinates have a negative area
+constexpr uint32_t CULL_POSITIVE_AREA = 1 << 0;
+constexpr uint32_t CULL_NEGATIVE_AREA = 1 << 1;
+
+// Snaps the vertices to the sub-pixel grid and computes the edge functions and the attribute planes.
+// Edge function of the edge opposite to a vertex is its unnormalized barycentric weight. It is evaluated
+// at pixel centers (integer coordinates) in pixel units, so a pixel is covered when all three are >= 0.
+// Pixels lying exactly on an edge belong to the triangle only if the edge is a top or a left one
+// (top-left fill rule), so pixels on an edge shared by two triangles are drawn exactly once. With multisampling
+// the same goes for the samples, the bounds include the pixels whose samples only are inside.
+// Zero area triangles and the ones whose winding is in cullMask are rejected here, before binning
+static bool setupTriangle(const Vertex &A, const Vertex &B, const Vertex &C, const Vec2i &vpMin, const Vec2i &vpMax, uint32_t cullMask,
+                          RsDepthFormat depthFormat, bool isTexture, bool isMultisample, RsTriangle &tri) {
+    const Vertex *verts[3] = { &A, &B, &C };
+    int64_t fx[3], fy[3];
+    for (int i = 0; i < 3; i++) {
+        const float x = verts[i]->pos.x;
+        const float y = verts[i]->pos.y;
+        if (!(Math::abs(x) < RS_MAX_COORD && Math::abs(y) < RS_MAX_COORD)) {
+            return false;
+        }
+        fx[i] = static_cast<int64_t>(floorf(x*RS_SUBPIXEL_SCALE + 0.5f));
+        fy[i] = static_cast<int64_t>(floorf(y*RS_SUBPIXEL_SCALE + 0.5f));
+    }
 
-            if (bcScreen.x >= 0 && bcScreen.y >= 0 && bcScreen.z >= 0) {
-                Vec4f bcClip = bcScreen*invABCz;
-                bcClip /= bcClip.x + bcClip.y + bcClip.z; // perspective-correction
+    int64_t area = (fx[1] - fx[0])*(fy[2] - fy[0]) - (fy[1] - fy[0])*(fx[2] - fx[0]);
+    if (area == 0 || (cullMask & (area < 0 ? CULL_NEGATIVE_AREA : CULL_POSITIVE_AREA))) {
+        return false;
+    }
+    if (area < 0) {
+        std::swap(verts[1], verts[2]);
+        std::swap(fx[1], fx[2]);
+        std::swap(fy[1], fy[2]);
+        area = -area;
+    }
 
-                const uint32_t idx = x + y*bufferSize.x;
-                if (isDepthTest) {
-                    const float depth = bcClip.x*B.pos.z + bcClip.y*C.pos.z + bcClip.z*A.pos.z;
-                    if (!compareFunc(depthFunc, depth, gDepthBuffer[idx])) {
-                        continue;
-                    }
-                    gDepthBuffer[idx] = depth;
-                }
+    // Pixel centers lie on integer coordinates, so round the sub-pixel bounds inwards
+    const int64_t margin = isMultisample ? RS_SAMPLE_MAX_OFFSET : 0;
+    const int64_t minFx = Math::min(fx[0], fx[1], fx[2]) - margin;
+    const int64_t minFy = Math::min(fy[0], fy[1], fy[2]) - margin;
+    const int64_t maxFx = Math::max(fx[0], fx[1], fx[2]) + margin;
+    const int64_t maxFy = Math::max(fy[0], fy[1], fy[2]) + margin;
+    tri.min.x = Math::max(static_cast<int>(-((-minFx) >> RS_SUBPIXEL_BITS)), vpMin.x);
+    tri.min.y = Math::max(static_cast<int>(-((-minFy) >> RS_SUBPIXEL_BITS)), vpMin.y);
+    tri.max.x = Math::min(static_cast<int>(maxFx >> RS_SUBPIXEL_BITS), vpMax.x);
+    tri.max.y = Math::min(static_cast<int>(maxFy >> RS_SUBPIXEL_BITS), vpMax.y);
+    if (tri.min.x > tri.max.x || tri.min.y > tri.max.y) {
+        return false;
+    }
 
-                gColorBuffer[idx][0] = bcScreen.dot(colorBCA[0]);
-                gColorBuffer[idx][1] = bcScreen.dot(colorBCA[1]);
-                gColorBuffer[idx][2] = bcScreen.dot(colorBCA[2]);
-                gColorBuffer[idx][3] = bcScreen.dot(colorBCA[3]);
+    for (int i = 0; i < 3; i++) {
+        const int a = (i + 1) % 3;
+        const int b = (i + 2) % 3;
+
+        // E(p) = stepX*p.x + stepY*p.y + c in sub-pixel units. Pixel centers are multiples of RS_SUBPIXEL_SCALE,
+        // so E(p) + bias >= 0 is equal to stepX*x + stepY*y + floor((c + bias) / RS_SUBPIXEL_SCALE) >= 0 for the pixel (x, y)
+        const int64_t stepX = fy[a] - fy[b];
+        const int64_t stepY = fx[b] - fx[a];
+        const int64_t c = -stepX*fx[a] - stepY*fy[a];
+
+        // Triangles are wound clockwise on the screen here, so top edges go right and left edges go up
+        const bool isTopLeft = stepX > 0 || (stepX == 0 && stepY > 0);
+        const int64_t bias = isTopLeft ? 0 : -1;
+
+        EdgeFunc &edge = tri.edges[i];
+        edge.stepX = static_cast<int32_t>(stepX);
+        edge.stepY = static_cast<int32_t>(stepY);
+        edge.k = stepX*tri.min.x + stepY*tri.min.y + ((c + bias) >> RS_SUBPIXEL_BITS);
+        if (isMultisample) {
+            for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+                const int64_t sampleC = c + stepX*RS_SAMPLE_OFFSETS[s][0] + stepY*RS_SAMPLE_OFFSETS[s][1];
+                edge.sampleOffsets[s] = static_cast<int32_t>(((sampleC + bias) >> RS_SUBPIXEL_BITS) - ((c + bias) >> RS_SUBPIXEL_BITS));
             }
         }
     }
+
+    const auto posA = Vec2f(static_cast<float>(fx[0]), static_cast<float>(fy[0])) / RS_SUBPIXEL_SCALE;
+    const auto posB = Vec2f(static_cast<float>(fx[1]), static_cast<float>(fy[1])) / RS_SUBPIXEL_SCALE;
+    const auto posC = Vec2f(static_cast<float>(fx[2]), static_cast<float>(fy[2])) / RS_SUBPIXEL_SCALE;
+    const auto AB = posB - posA;
+    const auto AC = posC - posA;
+    const float invArea = 1.0f / (AB.x*AC.y - AB.y*AC.x);
+
+    // Depth is interpolated in the units of the depth format. For the unorm formats the range is rounded like the
+    // stored values, so the hierarchical depth culling compares exactly the values the per pixel test would
+    float z[3];
+    for (int i = 0; i < 3; i++) {
+        z[i] = rsScaleDepth(depthFormat, verts[i]->pos.z);
+    }
+    tri.zMin = Math::min(z[0], z[1], z[2]);
+    tri.zMax = Math::max(z[0], z[1], z[2]);
+    if (depthFormat != RS_DEPTH_D32F) {
+        tri.zMin = nearbyintf(tri.zMin);
+        tri.zMax = nearbyintf(tri.zMax);
+    }
+    tri.z.setup(posA, AB, AC, invArea, z[0], z[1], z[2]);
+    for (int i = 0; i < 4; i++) {
+        tri.color[i].setup(posA, AB, AC, invArea, verts[0]->color[i], verts[1]->color[i], verts[2]->color[i]);
+    }
+    if (isTexture) {
+        tri.invW.setup(posA, AB, AC, invArea, verts[0]->pos.w, verts[1]->pos.w, verts[2]->pos.w);
+        for (int i = 0; i < 2; i++) {
+            tri.texCoord[i].setup(posA, AB, AC, invArea, verts[0]->texCoord[i]*verts[0]->pos.w,
+                                  verts[1]->texCoord[i]*verts[1]->pos.w, verts[2]->texCoord[i]*verts[2]->pos.w);
+        }
+    }
+    return true;
 }
 
-void drawTriangleBarycentricSIMD(const Vec2i &bufferSize, bool isDepthTest, uint32_t depthFunc, const Vec2i &vpMin, const Vec2i &vpMax,
-                                 const Vertex &A, const Vertex &B, const Vertex &C) {
-    __m128 BCAr_SIMD = _mm_setr_ps(B.color.r, C.color.r, A.color.r, 0.0f);
-    __m128 BCAg_SIMD = _mm_setr_ps(B.color.g, C.color.g, A.color.g, 0.0f);
-    __m128 BCAb_SIMD = _mm_setr_ps(B.color.b, C.color.b, A.color.b, 0.0f);
-    __m128 BCAa_SIMD = _mm_setr_ps(B.color.a, C.color.a, A.color.a, 0.0f);
+static void binTriangles(RsContext &rs, const std::vector<Vertex> &verts, const Vec2i &vpMin, const Vec2i &vpMax, uint32_t cullMask, bool isTexture) {
+    for (auto &bin : rs.tileBins) {
+        bin.clear();
+    }
 
-    const auto triMin = Vec2i(Vec4f::min(A.pos, B.pos, C.pos));
-    const auto triMax = Vec2i(Vec4f::max(A.pos, B.pos, C.pos));
-    const auto min = Vec2i::clamp(triMin, vpMin, vpMax);
-    const auto max = Vec2i::clamp(triMax, vpMin, vpMax);
+    rs.triangles.clear();
+    rs.triangles.reserve(verts.size() / 3);
 
-    __m128 invABCz_SIMD = _mm_rcp_ps(_mm_setr_ps(A.pos.z, B.pos.z, C.pos.z, 1.0f));
-    __m128 BCAz_SIMD = _mm_setr_ps(B.pos.z, C.pos.z, A.pos.z, 0.0f);
+    const size_t vertsCount = verts.size();
+    for (size_t i = 0; i + 2 < vertsCount; i += 3) {
+        RsTriangle tri;
+        if (!setupTriangle(verts[i + 0], verts[i + 1], verts[i + 2], vpMin, vpMax, cullMask, rs.depthFormat, isTexture, rs.isMultisample, tri)) {
+            continue;
+        }
 
-    const Vec4f AC = C.pos - A.pos;
-    const Vec4f AB = B.pos - A.pos;
+        const auto tileMin = tri.min - rs.bufferRect.min;
+        const auto tileMax = tri.max - rs.bufferRect.min;
+        const auto triIdx = static_cast<uint32_t>(rs.triangles.size());
+        rs.triangles.push_back(tri);
 
-    __m128 bcInvW_SIMD = _mm_rcp_ps(_mm_set_ps1(AB.x*AC.y - AC.x*AB.y));
+        for (int ty = tileMin.y / RS_TILE_SIZE; ty <= tileMax.y / RS_TILE_SIZE; ty++) {
+            for (int tx = tileMin.x / RS_TILE_SIZE; tx <= tileMax.x / RS_TILE_SIZE; tx++) {
+                rs.tileBins[tx + ty*rs.tilesCount.x].push_back(triIdx);
+            }
+        }
+    }
 
-    for (int y = min.y; y <= max.y; y++) {
-        const int PAy = A.pos.y - y;
+    rs.activeTiles.clear();
+    for (size_t i = 0; i < rs.tileBins.size(); i++) {
+        if (!rs.tileBins[i].empty()) {
+            rs.activeTiles.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
 
-        for (int x = min.x; x <= max.x; x++) {
-            const int PAx = A.pos.x - x;
+// Blending with GL_ONE, GL_ZERO and GL_FUNC_ADD writes the source as it is
+static bool isBlendEnabled(const GLState &state) {
+    return (state.caps & GL_CAP_BLEND) &&
+        !(state.blendSrcFactor == GL_ONE && state.blendDstFactor == GL_ZERO && state.blendEquation == GL_FUNC_ADD);
+}
 
-            const float bcU = AC.x*PAy - PAx*AC.y;
-            const float bcV = PAx*AB.y - AB.x*PAy;
+static RsBlendMode getBlendMode(const GLState &state) {
+    if (state.blendEquation == GL_FUNC_ADD) {
+        if (state.blendSrcFactor == GL_SRC_ALPHA && state.blendDstFactor == GL_ONE_MINUS_SRC_ALPHA) {
+            return RS_BLEND_ALPHA;
+        }
+        if (state.blendSrcFactor == GL_ONE && state.blendDstFactor == GL_ONE) {
+            return RS_BLEND_ADDITIVE;
+        }
+        if (state.blendSrcFactor == GL_ONE && state.blendDstFactor == GL_ONE_MINUS_SRC_ALPHA) {
+            return RS_BLEND_PREMULTIPLIED;
+        }
+    }
+    return RS_BLEND_GENERIC;
+}
 
-            __m128 bcScreen_SIMD = _mm_mul_ps(_mm_setr_ps(bcU, bcV, 0.0f, 0.0f), bcInvW_SIMD);
-            Vec4f bcScreen;
-            _mm_store_ps(bcScreen.data, bcScreen_SIMD);
-            bcScreen.z = 1.0f - bcScreen.x - bcScreen.y;
+// Returns the bound texture if texturing is enabled and it has an image
+static const GLTexture *getActiveTexture(const GLContext &ctx) {
+    const GLState &state = ctx.state;
+    if (!(state.caps & GL_CAP_TEXTURE_2D) || state.boundTexture == 0) {
+        return nullptr;
+    }
+    const GLTexture &texture = ctx.textures[state.boundTexture - 1];
+    if (texture.image.getMipLevelsCount() == 0) {
+        return nullptr;
+    }
+    return &texture;
+}
 
-            if (bcScreen.x >= 0 && bcScreen.y >= 0 && bcScreen.z >= 0) {
-                bcScreen_SIMD = _mm_load_ps(bcScreen.data);
+// Splits a minification filter into the filter inside a level and the one between the levels
+static void splitMinFilter(uint32_t filter, uint32_t &levelFilter, uint32_t &mipFilter) {
+    switch (filter) {
+        case GL_NEAREST_MIPMAP_NEAREST: levelFilter = GL_NEAREST; mipFilter = GL_NEAREST; break;
+        case GL_LINEAR_MIPMAP_NEAREST: levelFilter = GL_LINEAR; mipFilter = GL_NEAREST; break;
+        case GL_NEAREST_MIPMAP_LINEAR: levelFilter = GL_NEAREST; mipFilter = GL_LINEAR; break;
+        case GL_LINEAR_MIPMAP_LINEAR: levelFilter = GL_LINEAR; mipFilter = GL_LINEAR; break;
+        default: levelFilter = filter; mipFilter = GL_NONE; break;
+    }
+}
 
-                __m128 bcClip_SIMD = _mm_mul_ps(bcScreen_SIMD, invABCz_SIMD);
-                Vec4f bcClip;
-                _mm_store_ps(bcClip.data, bcClip_SIMD);
-                bcClip_SIMD = _mm_div_ps(bcClip_SIMD, _mm_set_ps1(bcClip.x + bcClip.y + bcClip.z));
-                _mm_store_ps(bcClip.data, bcClip_SIMD);
+static RsTileFunc selectTileFunc(const GLState &state, RsDepthFormat depthFormat, bool isTexture, bool isMultisample) {
+    const bool isDepthTest = (state.caps & GL_CAP_DEPTH_TEST) != 0;
+    const bool isColorWrite = state.colorMask != 0;
+    const bool isBlend = isBlendEnabled(state);
+    const size_t funcIdx = std::find(std::begin(gDepthFuncs), std::end(gDepthFuncs), state.depthFunc) - std::begin(gDepthFuncs);
+    if (funcIdx == std::size(gDepthFuncs)) {
+        return nullptr;
+    }
 
-                const uint32_t idx = x + y*bufferSize.x;
-                if (isDepthTest) {
-                    __m128 d = _mm_mul_ps(bcClip_SIMD, BCAz_SIMD);
-                    Vec4f dd;
-                    _mm_store_ps(dd.data, d);
-                    const float depth = dd.x + dd.y + dd.z;
-                    if (!compareFunc(depthFunc, depth, gDepthBuffer[idx])) {
-                        continue;
-                    }
-                    gDepthBuffer[idx] = depth;
-                }
+    const SimdLevel simdLevel = gSimdLevel;
+    const RsTileFunc *tileFuncs = rsGetTileFuncsSSE2();
+    if (simdLevel >= SIMD_AVX2) {
+        tileFuncs = rsGetTileFuncsAVX2();
+    }
+    else if (simdLevel >= SIMD_SSE41) {
+        tileFuncs = rsGetTileFuncsSSE41();
+    }
+    const size_t formatIdx = isMultisample*RS_DEPTH_FORMATS_COUNT + depthFormat;
+    return tileFuncs[(formatIdx << 8) | (isTexture << 7) | (isBlend << 6) | (isDepthTest << 5) | (funcIdx << 2) | (state.depthWrite << 1) | isColorWrite];
+}
 
-                __m128 rgba = _mm_dp_ps(bcScreen_SIMD, BCAr_SIMD, 0x71);
-                rgba = _mm_add_ps(rgba, _mm_dp_ps(bcScreen_SIMD, BCAg_SIMD, 0x72));
-                rgba = _mm_add_ps(rgba, _mm_dp_ps(bcScreen_SIMD, BCAb_SIMD, 0x74));
-                rgba = _mm_add_ps(rgba, _mm_dp_ps(bcScreen_SIMD, BCAa_SIMD, 0x78));
+static uint32_t getCullMask(const GLState &state) {
+    if (!(state.caps & GL_CAP_CULL_FACE)) {
+        return 0;
+    }
 
-                __m128i y = _mm_cvtps_epi32(rgba);
-                y = _mm_packus_epi32(y, y);
-                y = _mm_packus_epi16(y, y);
-                gColorBuffer[idx].rgba = _mm_cvtsi128_si32(y);
-            }
-        }
+    const uint32_t front = (state.frontFace == GL_CCW) ? CULL_NEGATIVE_AREA : CULL_POSITIVE_AREA;
+    const uint32_t back = front ^ (CULL_POSITIVE_AREA | CULL_NEGATIVE_AREA);
+    switch (state.cullFace) {
+        case GL_FRONT: return front;
+        case GL_BACK: return back;
+        case GL_FRONT_AND_BACK: return front | back;
+        default: return 0;
     }
 }
 
 void processTriangles() {
+    GLContext &ctx = *gCurrentContext;
+    const GLState &state = ctx.state;
+    RsContext &rs = ctx.rasterizer;
     const std::vector<Vertex> &verts = vpGetVertices();
-    size_t vertsCount = verts.size();
 
-    const Vec2 bufferSize = gCurrentContext->bufferRect.getSize();
-    const bool isDepthTest = gCurrentState->caps & GL_DEPTH_TEST;
-    const uint32_t depthFunc = gCurrentState->depthFunc;
-
-    const auto vpMin = Vec2i::clamp(gCurrentState->viewport.min, gCurrentContext->bufferRect.min, gCurrentContext->bufferRect.max);
-    const auto vpMax = Vec2i::clamp(gCurrentState->viewport.max, gCurrentContext->bufferRect.min, gCurrentContext->bufferRect.max);
+    RsDrawParams params;
+    params.bufferMin = rs.bufferRect.min;
+    params.bufferSize = rs.bufferRect.getSize();
+    params.colorBuffer = rs.colorBuffer;
+    params.colorPitch = rs.colorPitch;
+    params.depthBuffer = rs.depthBuffer;
+    params.hiZBuffer = rs.hiZBuffer;
+    params.hiZSize = rs.hiZSize;
+    std::copy(std::begin(rs.colorSamples), std::end(rs.colorSamples), params.colorSamples);
+    params.sampleFlags = rs.sampleFlags;
+    std::copy(std::begin(rs.depthSamples), std::end(rs.depthSamples), params.depthSamples);
+    params.vpMin = Vec2i::clamp(state.viewport.min, rs.bufferRect.min, rs.bufferRect.max);
+    params.vpMax = Vec2i::clamp(state.viewport.max, rs.bufferRect.min, rs.bufferRect.max);
+    params.colorMask = state.colorMask;
+    params.blendMode = getBlendMode(state);
+    params.blendSrcFactor = state.blendSrcFactor;
+    params.blendDstFactor = state.blendDstFactor;
+    params.blendEquation = state.blendEquation;
+
+    // Mipmapping uses the levels which form a chain from level 0, without any the base level is sampled
+    const GLTexture *texture = getActiveTexture(ctx);
+    const bool isTexture = texture && state.colorMask != 0;
+    if (isTexture) {
+        const TextureImage &image = texture->image;
+        params.texels = image.texels.data();
+        params.texLevels = image.levels.data();
+        splitMinFilter(texture->minFilter, params.texMinFilter, params.texMipFilter);
+        params.texMaxLevel = (params.texMipFilter != GL_NONE) ? image.getMipLevelsCount() - 1 : 0;
+        if (params.texMaxLevel == 0) {
+            params.texMipFilter = GL_NONE;
+        }
+        params.texMagFilter = texture->magFilter;
+        params.texWrapS = texture->wrapS;
+        params.texWrapT = texture->wrapT;
+    }
+    else {
+        params.texels = nullptr;
+    }
 
-    for (size_t i = 0; i < vertsCount; i += 3) {
-        const Vertex &A = verts[i + 0];
-        const Vertex &B = verts[i + 1];
-        const Vertex &C = verts[i + 2];
+    uint64_t *counters = ctx.counters;
+    const RsTileFunc tileFunc = selectTileFunc(state, rs.depthFormat, isTexture, rs.isMultisample);
+    const uint32_t cullMask = getCullMask(state);
+    if (!tileFunc || ((state.caps & GL_CAP_DEPTH_TEST) && state.depthFunc == GL_NEVER) ||
+        cullMask == (CULL_POSITIVE_AREA | CULL_NEGATIVE_AREA)) {
+        counters[GL_COUNTER_TRIANGLES_CULLED] += verts.size() / 3;
+        return;
+    }
 
-        drawTriangleBarycentricSIMD(bufferSize, isDepthTest, depthFunc, vpMin, vpMax, A, B, C);
+    StageTimer setupTimer(GL_STAGE_SETUP);
+    binTriangles(rs, verts, params.vpMin, params.vpMax, cullMask, isTexture);
+    setupTimer.stop();
+    counters[GL_COUNTER_TRIANGLES_CULLED] += verts.size() / 3 - rs.triangles.size();
+    counters[GL_COUNTER_TRIANGLES_RASTERIZED] += rs.triangles.size();
+    params.tilesCount = rs.tilesCount;
+    params.tileBins = rs.tileBins.data();
+    params.triangles = rs.triangles.data();
+
+    // Every tile owns its own part of the framebuffer, so tiles can be rasterized in parallel without locking.
+    // Triangles inside a tile are drawn in submission order, so the result is identical to the serial one.
+    // Every tile counts its pixels into its own slot, so the workers don't share any counters. The current
+    // context is per thread, so the workers get it from here
+    StageTimer rasterTimer(GL_STAGE_RASTER);
+    rs.activeTileStats.resize(rs.activeTiles.size());
+    ctx.threadPool.parallelFor(rs.activeTiles.size(), [&](size_t activeIdx) {
+        resolveTileClears(ctx, rs.activeTiles[activeIdx], RS_CLEAR_COLOR | RS_CLEAR_DEPTH, false);
+        rs.activeTileStats[activeIdx] = tileFunc(params, rs.activeTiles[activeIdx]);
+    });
+
+    for (const RsTileStats &tileStats : rs.activeTileStats) {
+        counters[GL_COUNTER_PIXELS_TESTED] += tileStats.pixelsTested;
+        counters[GL_COUNTER_PIXELS_PASSED] += tileStats.pixelsPassed;
+        counters[GL_COUNTER_SAMPLES_PASSED] += tileStats.samplesPassed;
     }
 }
 
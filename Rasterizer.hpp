@@ -2,10 +2,86 @@
 #include "Math.hpp"
 #include "VertexProcessor.hpp"
 
-void rsSetFramebuffer(const IntRect &rect, Color *colorBuffer, float *depthBuffer);
-const IntRect &rsGetFramebufferRect();
+struct GLContext;
+struct RsContext;
+
+constexpr int RS_TILE_SIZE = 64;
+constexpr int RS_BLOCK_SIZE = 4;
+constexpr int RS_SUBPIXEL_BITS = 8;
+constexpr int RS_SUBPIXEL_SCALE = 1 << RS_SUBPIXEL_BITS;
+constexpr float RS_MAX_COORD = static_cast<float>(1 << 19);
+
+// Multisampling keeps RS_SAMPLES_COUNT samples per pixel at these offsets from the pixel center, in sub-pixel units.
+// The grid is rotated, so edges close to horizontal or vertical cross the samples one at a time
+constexpr int RS_SAMPLES_COUNT = 4;
+constexpr int RS_SAMPLE_OFFSETS[RS_SAMPLES_COUNT][2] = { { -32, -96 }, { 96, -32 }, { -96, 32 }, { 32, 96 } };
+constexpr int RS_SAMPLE_MAX_OFFSET = 96; // along either axis
+
+// Bounds of the depth values of one RS_BLOCK_SIZE x RS_BLOCK_SIZE block of the depth buffer, in the units
+// of the depth format (see rsScaleDepth)
+struct DepthRange {
+    float min, max;
+};
+
+// Depth buffer formats. Unorm formats map the depth range [-1, 1] to [0, rsGetDepthFormatMax]
+enum RsDepthFormat {
+    RS_DEPTH_D32F,
+    RS_DEPTH_D24S8, // depth in the low 24 bits, stencil in the top 8 bits
+    RS_DEPTH_D16,
+    RS_DEPTH_FORMATS_COUNT,
+};
+
+constexpr uint32_t RS_STENCIL_MASK = 0xFF000000;
+
+constexpr int rsGetDepthFormatSize(RsDepthFormat format) {
+    return format == RS_DEPTH_D16 ? 2 : 4;
+}
+
+constexpr uint32_t rsGetDepthFormatMax(RsDepthFormat format) {
+    return format == RS_DEPTH_D16 ? 0xFFFF : 0xFFFFFF;
+}
+
+// Converts depth to the units of format, which the triangle setup interpolates and the hierarchical depth stores.
+// Unorm formats use their integer steps, so the kernels only round
+inline float rsScaleDepth(RsDepthFormat format, float depth) {
+    if (format == RS_DEPTH_D32F) {
+        return depth;
+    }
+    return Math::clamp(depth*0.5f + 0.5f, 0.0f, 1.0f)*static_cast<float>(rsGetDepthFormatMax(format));
+}
+
+// Returns the stored bits of the depth value, the stencil of D24S8 is 0
+inline uint32_t rsEncodeDepth(RsDepthFormat format, float depth) {
+    const float scaled = rsScaleDepth(format, depth);
+    if (format == RS_DEPTH_D32F) {
+        uint32_t bits;
+        memcpy(&bits, &scaled, sizeof(bits));
+        return bits;
+    }
+    return static_cast<uint32_t>(_mm_cvtss_si32(_mm_set_ss(scaled)));
+}
+
+// Pending fast clears of a tile
+constexpr uint8_t RS_CLEAR_COLOR = 1 << 0;
+constexpr uint8_t RS_CLEAR_DEPTH = 1 << 1;
+
+Vec2i rsGetHiZSize(const Vec2i &bufferSize);
+Vec2i rsGetTilesCount(const Vec2i &bufferSize);
+
+// Rows of the color buffer are colorPitch pixels apart, the depth buffer has no padding
+void rsSetFramebuffer(RsContext &rs, const IntRect &rect, Color *colorBuffer, int colorPitch, void *depthBuffer, RsDepthFormat depthFormat,
+                      DepthRange *hiZBuffer);
+// Enables multisampling, which draws into the sample buffers and leaves the color buffer for rsResolveSamples.
+// colorSamples holds RS_SAMPLES_COUNT planes of the framebuffer's size and depthSamples the planes after the first
+// one, which is the depth buffer. sampleFlags has a byte per pixel. Null colorSamples disables multisampling
+void rsSetSampleBuffers(RsContext &rs, Color *colorSamples, uint8_t *sampleFlags, void *depthSamples);
 
 void rsClearColor(const Color &color);
 void rsClearDepth(float depth);
 
+// Writes the pending fast clears of the buffers selected by the RS_CLEAR_* bits in flags
+void rsResolveClears(GLContext *ctx, uint8_t flags);
+// Averages the color samples into the color buffer, the pending color clears must be written already
+void rsResolveSamples(GLContext *ctx);
+
 void rsProcess();
@@ -0,0 +1,9 @@
+// Same source as the SSE4.1 kernels, AVX2 targeting gets them VEX encoded
+#define RS_TARGET VGL_TARGET_AVX2
+#define RS_USE_SSE41 1
+#define RS_USE_AVX2 1
+#include "RasterizerKernels.inl"
+
+const RsTileFunc *rsGetTileFuncsAVX2() {
+    return gTileFuncs.data();
+}
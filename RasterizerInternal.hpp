@@ -0,0 +1,119 @@
+#pragma once
+#include "GL.hpp"
+#include "Math.hpp"
+#include "Rasterizer.hpp"
+#include "Texture.hpp"
+#include <vector>
+
+struct EdgeFunc {
+    int64_t k; // value at the triangle's bounding box min
+    int32_t stepX, stepY;
+    int32_t sampleOffsets[RS_SAMPLES_COUNT]; // added to the value at a pixel center to get the value at its samples
+};
+
+struct AttribPlane {
+    float dx, dy, c;
+
+    void setup(const Vec2f &A, const Vec2f &AB, const Vec2f &AC, float invArea, float fA, float fB, float fC) {
+        const float dfB = fB - fA;
+        const float dfC = fC - fA;
+        this->dx = (dfB*AC.y - dfC*AB.y)*invArea;
+        this->dy = (dfC*AB.x - dfB*AC.x)*invArea;
+        this->c = fA - this->dx*A.x - this->dy*A.y;
+    }
+};
+
+struct RsTriangle {
+    Vec2i min, max;
+    EdgeFunc edges[3];
+    float zMin, zMax;
+    AttribPlane z;
+    AttribPlane color[4];
+    // Texture coordinates are interpolated as u/w, v/w and 1/w, which are linear in screen space, and divided per pixel
+    AttribPlane invW;
+    AttribPlane texCoord[2];
+};
+
+// Blend functions with their own code paths in the kernels, the rest goes through RS_BLEND_GENERIC
+enum RsBlendMode {
+    RS_BLEND_ALPHA, // GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    RS_BLEND_ADDITIVE, // GL_ONE, GL_ONE
+    RS_BLEND_PREMULTIPLIED, // GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+    RS_BLEND_GENERIC,
+};
+
+// Framebuffer, binned triangles and the pipeline state which is not baked into the kernels' template parameters
+struct RsDrawParams {
+    Vec2i bufferMin, bufferSize;
+    Color *colorBuffer;
+    int colorPitch; // in pixels
+    void *depthBuffer; // in the kernel's depth format, rows without padding
+    DepthRange *hiZBuffer;
+    Vec2i hiZSize;
+    // Planes of the multisampling kernels, without padding. depthSamples[0] is depthBuffer
+    Color *colorSamples[RS_SAMPLES_COUNT];
+    uint8_t *sampleFlags;
+    void *depthSamples[RS_SAMPLES_COUNT];
+
+    Vec2i tilesCount;
+    const std::vector<uint32_t> *tileBins;
+    const RsTriangle *triangles;
+
+    Vec2i vpMin, vpMax;
+    uint32_t colorMask;
+    RsBlendMode blendMode;
+    uint32_t blendSrcFactor, blendDstFactor, blendEquation; // for RS_BLEND_GENERIC
+
+    // Texture modulating the color. The filters inside a level are GL_NEAREST or GL_LINEAR, texMipFilter is
+    // GL_NONE without mipmapping. Pixels take their level from the level of detail of their 2x2 quad
+    const Color *texels; // of all levels
+    const TextureLevel *texLevels;
+    int texMaxLevel;
+    uint32_t texMinFilter, texMagFilter, texMipFilter;
+    uint32_t texWrapS, texWrapT;
+};
+
+// Pixel counters of one tile, merged into the context's counters after the draw
+struct RsTileStats {
+    uint64_t pixelsTested;
+    uint64_t pixelsPassed;
+    uint64_t samplesPassed; // pixelsPassed without multisampling
+};
+
+// Framebuffer of a context as the rasterizer sees it and the scratch buffers of its draws. Every context
+// has its own, so contexts current on different threads draw without sharing anything
+struct RsContext {
+    IntRect bufferRect = IntRect(0, 0, 0, 0);
+    Color *colorBuffer = nullptr;
+    int colorPitch = 0; // in pixels
+    void *depthBuffer = nullptr;
+    RsDepthFormat depthFormat = RS_DEPTH_D32F;
+    DepthRange *hiZBuffer = nullptr;
+    Vec2i hiZSize = Vec2i(0, 0);
+
+    // Sample buffers, see rsSetSampleBuffers. A set flag means all the samples of the pixel have the color of the
+    // first one, which is the only one written then. Clears and fully covered pixels keep most of them set
+    bool isMultisample = false;
+    Color *colorSamples[RS_SAMPLES_COUNT] = {};
+    uint8_t *sampleFlags = nullptr;
+    void *depthSamples[RS_SAMPLES_COUNT] = {};
+
+    Vec2i tilesCount = Vec2i(0, 0);
+    std::vector<std::vector<uint32_t>> tileBins;
+    std::vector<uint32_t> activeTiles;
+    std::vector<RsTileStats> activeTileStats;
+    std::vector<RsTriangle> triangles;
+};
+
+using RsTileFunc = RsTileStats(*)(const RsDrawParams &params, uint32_t tileIdx);
+
+static constexpr uint32_t gDepthFuncs[] = { GL_NEVER, GL_LESS, GL_EQUAL, GL_LEQUAL, GL_GREATER, GL_NOTEQUAL, GL_GEQUAL, GL_ALWAYS };
+
+// Tile kernels are compiled once per SimdLevel from RasterizerKernels.inl. Each table has RS_TILE_FUNCS_COUNT entries,
+// index layout: bit 0 - color write, bit 1 - depth write, bits 2-4 - depth func, bit 5 - depth test, bit 6 - blend,
+// bit 7 - texture, the rest - depth format, plus RS_DEPTH_FORMATS_COUNT with multisampling
+constexpr size_t RS_TILE_FUNCS_COUNT = 256*RS_DEPTH_FORMATS_COUNT*2;
+
+const RsTileFunc *rsGetTileFuncsSSE2();
+const RsTileFunc *rsGetTileFuncsSSE41();
+const RsTileFunc *rsGetTileFuncsAVX2();
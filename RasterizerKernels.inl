@@ -0,0 +1,1017 @@
+// Tile kernels, included by one translation unit per SimdLevel. The including file defines RS_TARGET,
+// the target attribute of every kernel function, RS_USE_SSE41 for the SSE4.1 code paths and RS_USE_AVX2 for the AVX2 ones.
+// Everything here has internal linkage, so the differently compiled copies never mix at link time
+#include "RasterizerInternal.hpp"
+#include "Platform.hpp"
+#include <array>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+// Returns true if no depth in [zMin, zMax] can pass DepthFunc against any depth inside the range
+template<uint32_t DepthFunc>
+static VGL_FORCEINLINE RS_TARGET bool VGL_FASTCALL isDepthRangeOccluded(float zMin, float zMax, const DepthRange &range) {
+    const float epsilon = std::numeric_limits<float>::epsilon();
+
+    if constexpr (DepthFunc == GL_NEVER) {
+        return true;
+    }
+    else if constexpr (DepthFunc == GL_LESS) {
+        return zMin >= range.max;
+    }
+    else if constexpr (DepthFunc == GL_EQUAL) {
+        return zMin - range.max >= epsilon || range.min - zMax >= epsilon;
+    }
+    else if constexpr (DepthFunc == GL_LEQUAL) {
+        return zMin > range.max;
+    }
+    else if constexpr (DepthFunc == GL_GREATER) {
+        return zMax <= range.min;
+    }
+    else if constexpr (DepthFunc == GL_GEQUAL) {
+        return zMax < range.min;
+    }
+    else {
+        return false;
+    }
+}
+
+template<uint32_t DepthFunc>
+static VGL_FORCEINLINE RS_TARGET __m128 VGL_FASTCALL compareFuncSIMD(__m128 lhs, __m128 rhs) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 epsilon = _mm_set_ps1(std::numeric_limits<float>::epsilon());
+
+    if constexpr (DepthFunc == GL_NEVER) {
+        return _mm_setzero_ps();
+    }
+    else if constexpr (DepthFunc == GL_LESS) {
+        return _mm_cmplt_ps(lhs, rhs);
+    }
+    else if constexpr (DepthFunc == GL_EQUAL) {
+        return _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(lhs, rhs), absMask), epsilon);
+    }
+    else if constexpr (DepthFunc == GL_LEQUAL) {
+        return _mm_cmple_ps(lhs, rhs);
+    }
+    else if constexpr (DepthFunc == GL_GREATER) {
+        return _mm_cmpgt_ps(lhs, rhs);
+    }
+    else if constexpr (DepthFunc == GL_NOTEQUAL) {
+        return _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(lhs, rhs), absMask), epsilon);
+    }
+    else if constexpr (DepthFunc == GL_GEQUAL) {
+        return _mm_cmpge_ps(lhs, rhs);
+    }
+    else {
+        return _mm_castsi128_ps(_mm_set1_epi32(-1));
+    }
+}
+
+// Depth values of RS_BLOCK_SIZE pixels are kept in 32-bit lanes in every format: the float bits for D32F,
+// the zero extended value for D16 and the packed value with the stencil in the top byte for D24S8
+template<RsDepthFormat DepthFormat>
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL loadDepth(const void *buffer, uint32_t idx, int lanesCount) {
+    if constexpr (DepthFormat == RS_DEPTH_D16) {
+        const uint16_t *src = static_cast<const uint16_t*>(buffer) + idx;
+        if (lanesCount == RS_BLOCK_SIZE) {
+            return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_setzero_si128());
+        }
+        alignas(16) uint32_t depth[RS_BLOCK_SIZE] = {};
+        for (int i = 0; i < lanesCount; i++) {
+            depth[i] = src[i];
+        }
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(depth));
+    }
+    else {
+        const uint32_t *src = static_cast<const uint32_t*>(buffer) + idx;
+        if (lanesCount == RS_BLOCK_SIZE) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        }
+        alignas(16) uint32_t depth[RS_BLOCK_SIZE] = {};
+        for (int i = 0; i < lanesCount; i++) {
+            depth[i] = src[i];
+        }
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(depth));
+    }
+}
+
+template<RsDepthFormat DepthFormat>
+static VGL_FORCEINLINE RS_TARGET void VGL_FASTCALL storeDepth(void *buffer, uint32_t idx, int lanesCount, __m128i depth) {
+    if constexpr (DepthFormat == RS_DEPTH_D16) {
+#if RS_USE_SSE41
+        const __m128i packed = _mm_packus_epi32(depth, depth);
+#else
+        // No unsigned 32 to 16 bit pack before SSE4.1, so gather the low halves
+        __m128i packed = _mm_shufflelo_epi16(depth, _MM_SHUFFLE(3, 3, 2, 0));
+        packed = _mm_shufflehi_epi16(packed, _MM_SHUFFLE(3, 3, 2, 0));
+        packed = _mm_shuffle_epi32(packed, _MM_SHUFFLE(3, 3, 2, 0));
+#endif
+        uint16_t *dst = static_cast<uint16_t*>(buffer) + idx;
+        if (lanesCount == RS_BLOCK_SIZE) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), packed);
+            return;
+        }
+        alignas(16) uint16_t values[RS_BLOCK_SIZE*2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(values), packed);
+        for (int i = 0; i < lanesCount; i++) {
+            dst[i] = values[i];
+        }
+    }
+    else {
+        uint32_t *dst = static_cast<uint32_t*>(buffer) + idx;
+        if (lanesCount == RS_BLOCK_SIZE) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), depth);
+            return;
+        }
+        alignas(16) uint32_t values[RS_BLOCK_SIZE];
+        _mm_store_si128(reinterpret_cast<__m128i*>(values), depth);
+        for (int i = 0; i < lanesCount; i++) {
+            dst[i] = values[i];
+        }
+    }
+}
+
+// Converts interpolated depths, already in the format's units, to the stored values. D24S8 keeps the stencil of old
+template<RsDepthFormat DepthFormat>
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL encodeDepth(__m128 z, __m128i old) {
+    if constexpr (DepthFormat == RS_DEPTH_D32F) {
+        return _mm_castps_si128(z);
+    }
+    else if constexpr (DepthFormat == RS_DEPTH_D24S8) {
+        return _mm_or_si128(_mm_cvtps_epi32(z), _mm_and_si128(old, _mm_set1_epi32(RS_STENCIL_MASK)));
+    }
+    else {
+        return _mm_cvtps_epi32(z);
+    }
+}
+
+// Converts stored depth values to the format's units, which is exact for the unorm formats
+template<RsDepthFormat DepthFormat>
+static VGL_FORCEINLINE RS_TARGET __m128 VGL_FASTCALL decodeDepth(__m128i depth) {
+    if constexpr (DepthFormat == RS_DEPTH_D32F) {
+        return _mm_castsi128_ps(depth);
+    }
+    else {
+        return _mm_cvtepi32_ps(_mm_and_si128(depth, _mm_set1_epi32(rsGetDepthFormatMax(DepthFormat))));
+    }
+}
+
+// Unorm depths are compared as integers, so GL_EQUAL means the same stored value
+template<uint32_t DepthFunc>
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL compareFuncSIMD(__m128i lhs, __m128i rhs) {
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    if constexpr (DepthFunc == GL_NEVER) {
+        return _mm_setzero_si128();
+    }
+    else if constexpr (DepthFunc == GL_LESS) {
+        return _mm_cmplt_epi32(lhs, rhs);
+    }
+    else if constexpr (DepthFunc == GL_EQUAL) {
+        return _mm_cmpeq_epi32(lhs, rhs);
+    }
+    else if constexpr (DepthFunc == GL_LEQUAL) {
+        return _mm_xor_si128(_mm_cmpgt_epi32(lhs, rhs), ones);
+    }
+    else if constexpr (DepthFunc == GL_GREATER) {
+        return _mm_cmpgt_epi32(lhs, rhs);
+    }
+    else if constexpr (DepthFunc == GL_NOTEQUAL) {
+        return _mm_xor_si128(_mm_cmpeq_epi32(lhs, rhs), ones);
+    }
+    else if constexpr (DepthFunc == GL_GEQUAL) {
+        return _mm_xor_si128(_mm_cmplt_epi32(lhs, rhs), ones);
+    }
+    else {
+        return ones;
+    }
+}
+
+template<uint32_t DepthFunc, RsDepthFormat DepthFormat>
+static VGL_FORCEINLINE RS_TARGET int VGL_FASTCALL depthTest(__m128i z, __m128i old) {
+    if constexpr (DepthFormat == RS_DEPTH_D32F) {
+        return _mm_movemask_ps(compareFuncSIMD<DepthFunc>(_mm_castsi128_ps(z), _mm_castsi128_ps(old)));
+    }
+    else {
+        const __m128i valueMask = _mm_set1_epi32(rsGetDepthFormatMax(DepthFormat));
+        return _mm_movemask_ps(_mm_castsi128_ps(compareFuncSIMD<DepthFunc>(_mm_and_si128(z, valueMask), _mm_and_si128(old, valueMask))));
+    }
+}
+
+static const uint8_t gBitsCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL expandMask(int mask) {
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits);
+}
+
+// Blending works on 2 pixels per register in 16-bit fixed point, the channels are in [0, 255]
+
+// Rounded x / 255 for x in [0, 255*255], exact
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL div255(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL broadcastAlpha(__m128i color) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(color, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static RS_TARGET __m128i getBlendFactor(uint32_t factor, __m128i src, __m128i dst) {
+    const __m128i ones = _mm_set1_epi16(255);
+    switch (factor) {
+        case GL_ZERO: return _mm_setzero_si128();
+        case GL_SRC_COLOR: return src;
+        case GL_ONE_MINUS_SRC_COLOR: return _mm_sub_epi16(ones, src);
+        case GL_SRC_ALPHA: return broadcastAlpha(src);
+        case GL_ONE_MINUS_SRC_ALPHA: return _mm_sub_epi16(ones, broadcastAlpha(src));
+        case GL_DST_ALPHA: return broadcastAlpha(dst);
+        case GL_ONE_MINUS_DST_ALPHA: return _mm_sub_epi16(ones, broadcastAlpha(dst));
+        case GL_DST_COLOR: return dst;
+        case GL_ONE_MINUS_DST_COLOR: return _mm_sub_epi16(ones, dst);
+        case GL_SRC_ALPHA_SATURATE: {
+            // min(As, 1 - Ad) for the color, 1 for the alpha
+            const __m128i f = _mm_min_epi16(broadcastAlpha(src), _mm_sub_epi16(ones, broadcastAlpha(dst)));
+            const __m128i alphaMask = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+            return _mm_or_si128(_mm_andnot_si128(alphaMask, f), _mm_and_si128(alphaMask, ones));
+        }
+        default: return ones;
+    }
+}
+
+static RS_TARGET __m128i blendGeneric(const RsDrawParams &params, __m128i src, __m128i dst) {
+    if (params.blendEquation == GL_MIN) {
+        return _mm_min_epi16(src, dst);
+    }
+    else if (params.blendEquation == GL_MAX) {
+        return _mm_max_epi16(src, dst);
+    }
+
+    const __m128i s = div255(_mm_mullo_epi16(src, getBlendFactor(params.blendSrcFactor, src, dst)));
+    const __m128i d = div255(_mm_mullo_epi16(dst, getBlendFactor(params.blendDstFactor, src, dst)));
+    switch (params.blendEquation) {
+        case GL_FUNC_SUBTRACT: return _mm_subs_epu16(s, d);
+        case GL_FUNC_REVERSE_SUBTRACT: return _mm_subs_epu16(d, s);
+        default: return _mm_add_epi16(s, d); // saturated by the final pack
+    }
+}
+
+// Blends 4 source pixels over 4 destination pixels, both RGBA8
+static RS_TARGET __m128i blendColors(const RsDrawParams &params, __m128i src, __m128i dst) {
+    if (params.blendMode == RS_BLEND_ADDITIVE) {
+        return _mm_adds_epu8(src, dst);
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(255);
+    const __m128i srcHalves[2] = { _mm_unpacklo_epi8(src, zero), _mm_unpackhi_epi8(src, zero) };
+    const __m128i dstHalves[2] = { _mm_unpacklo_epi8(dst, zero), _mm_unpackhi_epi8(dst, zero) };
+    __m128i results[2];
+    for (int i = 0; i < 2; i++) {
+        const __m128i s = srcHalves[i];
+        const __m128i d = dstHalves[i];
+        if (params.blendMode == RS_BLEND_ALPHA) {
+            // s*a + d*(1 - a) is at most 255*255, so it fits the unsigned 16-bit lanes before the division
+            const __m128i a = broadcastAlpha(s);
+            results[i] = div255(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(ones, a))));
+        }
+        else if (params.blendMode == RS_BLEND_PREMULTIPLIED) {
+            results[i] = _mm_add_epi16(s, div255(_mm_mullo_epi16(d, _mm_sub_epi16(ones, broadcastAlpha(s)))));
+        }
+        else {
+            results[i] = blendGeneric(params, s, d);
+        }
+    }
+    return _mm_packus_epi16(results[0], results[1]);
+}
+
+static VGL_FORCEINLINE RS_TARGET __m128 VGL_FASTCALL evalPlane(const AttribPlane &plane, __m128 xs, __m128 ys) {
+    return _mm_add_ps(_mm_set_ps1(plane.c), _mm_add_ps(_mm_mul_ps(_mm_set_ps1(plane.dx), xs), _mm_mul_ps(_mm_set_ps1(plane.dy), ys)));
+}
+
+// Valid for |v| < 2^31, the SSE2 version adjusts the truncated values
+static VGL_FORCEINLINE RS_TARGET __m128 VGL_FASTCALL floorPs(__m128 v) {
+#if RS_USE_SSE41
+    return _mm_floor_ps(v);
+#else
+    const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set_ps1(1.0f)));
+#endif
+}
+
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL selectEpi32(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL clampEpi32(__m128i v, __m128i mins, __m128i maxs) {
+#if RS_USE_SSE41
+    return _mm_min_epi32(_mm_max_epi32(v, mins), maxs);
+#else
+    v = selectEpi32(_mm_cmplt_epi32(v, mins), mins, v);
+    return selectEpi32(_mm_cmpgt_epi32(v, maxs), maxs, v);
+#endif
+}
+
+// Low 32 bits of the products, the SSE2 version is for non-negative values
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL mulloEpi32(__m128i a, __m128i b) {
+#if RS_USE_SSE41
+    return _mm_mullo_epi32(a, b);
+#else
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+// Approximate log2 of positive values, the exponent plus a quadratic fit of log2(1 + t) for the mantissa 1 + t.
+// The fit is exact for t = 0 and t = 1, so powers of 2 give exact results and the error stays below 0.008
+static VGL_FORCEINLINE RS_TARGET __m128 VGL_FASTCALL log2Ps(__m128 x) {
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    const __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFF)), _mm_set1_epi32(0x3F800000)));
+    const __m128 t = _mm_sub_ps(m, _mm_set_ps1(1.0f));
+    return _mm_add_ps(exponent, _mm_mul_ps(t, _mm_sub_ps(_mm_set_ps1(1.34655f), _mm_mul_ps(t, _mm_set_ps1(0.34655f)))));
+}
+
+// Multiplies two RGBA8 colors per channel, as GL_MODULATE does
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL modulateColors(__m128i a, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+    const __m128i hi = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+    return _mm_packus_epi16(lo, hi);
+}
+
+// Mip level of every lane
+struct TexLevelLanes {
+    __m128i sizeX, sizeY;
+    __m128i tilesPerRow;
+    __m128i offset;
+};
+
+static RS_TARGET TexLevelLanes getLevelLanes(const TextureLevel &level) {
+    TexLevelLanes lanes;
+    lanes.sizeX = _mm_set1_epi32(level.size.x);
+    lanes.sizeY = _mm_set1_epi32(level.size.y);
+    lanes.tilesPerRow = _mm_set1_epi32(level.tilesPerRow);
+    lanes.offset = _mm_set1_epi32(static_cast<int>(level.offset));
+    return lanes;
+}
+
+static RS_TARGET TexLevelLanes getLevelLanes(const RsDrawParams &params, __m128i levels) {
+    alignas(16) int idx[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(idx), levels);
+    if (idx[0] == idx[1] && idx[0] == idx[2] && idx[0] == idx[3]) {
+        return getLevelLanes(params.texLevels[idx[0]]);
+    }
+    const TextureLevel *l[4] = { &params.texLevels[idx[0]], &params.texLevels[idx[1]], &params.texLevels[idx[2]], &params.texLevels[idx[3]] };
+    TexLevelLanes lanes;
+    lanes.sizeX = _mm_setr_epi32(l[0]->size.x, l[1]->size.x, l[2]->size.x, l[3]->size.x);
+    lanes.sizeY = _mm_setr_epi32(l[0]->size.y, l[1]->size.y, l[2]->size.y, l[3]->size.y);
+    lanes.tilesPerRow = _mm_setr_epi32(l[0]->tilesPerRow, l[1]->tilesPerRow, l[2]->tilesPerRow, l[3]->tilesPerRow);
+    lanes.offset = _mm_setr_epi32(static_cast<int>(l[0]->offset), static_cast<int>(l[1]->offset), static_cast<int>(l[2]->offset), static_cast<int>(l[3]->offset));
+    return lanes;
+}
+
+// Scales texture coordinates to texels. GL_REPEAT keeps the fractional part first, which gives [0, size],
+// GL_CLAMP_TO_EDGE limits them to [-1, size + 1]. Both keep the values in the range of the integer conversions
+static RS_TARGET __m128 scaleTexCoords(__m128 t, __m128i sizes, uint32_t wrap) {
+    const float maxExact = 8388608.0f; // 2^23, floats above it have no fractional part
+    const __m128 sizesF = _mm_cvtepi32_ps(sizes);
+    t = _mm_max_ps(_mm_min_ps(t, _mm_set_ps1(maxExact)), _mm_set_ps1(-maxExact)); // NaNs become maxExact too
+    if (wrap == GL_REPEAT) {
+        return _mm_mul_ps(_mm_sub_ps(t, floorPs(t)), sizesF);
+    }
+    t = _mm_mul_ps(t, sizesF);
+    return _mm_max_ps(_mm_min_ps(t, _mm_add_ps(sizesF, _mm_set_ps1(1.0f))), _mm_set_ps1(-1.0f));
+}
+
+// Moves integer texel coordinates in [-2, size] inside the level
+static RS_TARGET __m128i wrapTexels(__m128i i, __m128i sizes, uint32_t wrap) {
+    if (wrap == GL_REPEAT) {
+        i = _mm_add_epi32(i, _mm_and_si128(_mm_cmplt_epi32(i, _mm_setzero_si128()), sizes));
+        return _mm_sub_epi32(i, _mm_andnot_si128(_mm_cmplt_epi32(i, sizes), sizes));
+    }
+    return clampEpi32(i, _mm_setzero_si128(), _mm_sub_epi32(sizes, _mm_set1_epi32(1)));
+}
+
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL spreadBits(__m128i v) {
+    v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 2)), _mm_set1_epi32(0x33));
+    return _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 1)), _mm_set1_epi32(0x55));
+}
+
+// Same as TextureLevel::getTexelIndex for 4 texels
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL getTexelIndices(const TexLevelLanes &lanes, __m128i x, __m128i y) {
+    const __m128i mask = _mm_set1_epi32(TEX_TILE_SIZE - 1);
+    const __m128i tileRow = mulloEpi32(_mm_srli_epi32(y, TEX_TILE_BITS), lanes.tilesPerRow);
+    const __m128i tile = _mm_add_epi32(tileRow, _mm_srli_epi32(x, TEX_TILE_BITS));
+    const __m128i morton = _mm_or_si128(spreadBits(_mm_and_si128(x, mask)), _mm_slli_epi32(spreadBits(_mm_and_si128(y, mask)), 1));
+    return _mm_add_epi32(lanes.offset, _mm_or_si128(_mm_slli_epi32(tile, 2*TEX_TILE_BITS), morton));
+}
+
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL fetchTexels(const Color *texels, const TexLevelLanes &lanes, __m128i x, __m128i y) {
+    const __m128i indices = getTexelIndices(lanes, x, y);
+#if RS_USE_AVX2
+    return _mm_i32gather_epi32(reinterpret_cast<const int*>(texels), indices, 4);
+#else
+    alignas(16) uint32_t idx[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(idx), indices);
+    return _mm_setr_epi32(texels[idx[0]].rgba, texels[idx[1]].rgba, texels[idx[2]].rgba, texels[idx[3]].rgba);
+#endif
+}
+
+// (a*(256 - w) + b*w) / 256 rounded, per 16-bit channel with w in [0, 256]
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL lerpChannels(__m128i a, __m128i b, __m128i w) {
+    const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(_mm_set1_epi16(256), w)), _mm_mullo_epi16(b, w));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+}
+
+// Copies the 32-bit weights of the lanes 2*half and 2*half + 1 to the 16-bit channels of their pixels
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL expandWeights(__m128i w, int half) {
+    const __m128i pairs = (half == 0) ? _mm_unpacklo_epi32(w, w) : _mm_unpackhi_epi32(w, w);
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pairs, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+// Interpolates 4 RGBA8 colors with the 32-bit weights in [0, 256]
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL lerpColors(__m128i a, __m128i b, __m128i w) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = lerpChannels(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), expandWeights(w, 0));
+    const __m128i hi = lerpChannels(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), expandWeights(w, 1));
+    return _mm_packus_epi16(lo, hi);
+}
+
+static RS_TARGET __m128i sampleNearest(const RsDrawParams &params, const TexLevelLanes &lanes, __m128 u, __m128 v) {
+    const __m128i x = _mm_cvttps_epi32(floorPs(scaleTexCoords(u, lanes.sizeX, params.texWrapS)));
+    const __m128i y = _mm_cvttps_epi32(floorPs(scaleTexCoords(v, lanes.sizeY, params.texWrapT)));
+    return fetchTexels(params.texels, lanes, wrapTexels(x, lanes.sizeX, params.texWrapS), wrapTexels(y, lanes.sizeY, params.texWrapT));
+}
+
+// Weights of the 2x2 texels have 8 bits of precision, the channels are filtered in 16-bit fixed point
+static RS_TARGET __m128i sampleBilinear(const RsDrawParams &params, const TexLevelLanes &lanes, __m128 u, __m128 v) {
+    const __m128 half = _mm_set_ps1(0.5f);
+    const __m128 scale = _mm_set_ps1(256.0f);
+    const __m128 x = _mm_sub_ps(scaleTexCoords(u, lanes.sizeX, params.texWrapS), half);
+    const __m128 y = _mm_sub_ps(scaleTexCoords(v, lanes.sizeY, params.texWrapT), half);
+    const __m128 x0 = floorPs(x);
+    const __m128 y0 = floorPs(y);
+    const __m128i wx = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(x, x0), scale));
+    const __m128i wy = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(y, y0), scale));
+
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i ix = _mm_cvttps_epi32(x0);
+    const __m128i iy = _mm_cvttps_epi32(y0);
+    const __m128i xs[2] = { wrapTexels(ix, lanes.sizeX, params.texWrapS), wrapTexels(_mm_add_epi32(ix, one), lanes.sizeX, params.texWrapS) };
+    const __m128i ys[2] = { wrapTexels(iy, lanes.sizeY, params.texWrapT), wrapTexels(_mm_add_epi32(iy, one), lanes.sizeY, params.texWrapT) };
+    const __m128i top = lerpColors(fetchTexels(params.texels, lanes, xs[0], ys[0]), fetchTexels(params.texels, lanes, xs[1], ys[0]), wx);
+    const __m128i bottom = lerpColors(fetchTexels(params.texels, lanes, xs[0], ys[1]), fetchTexels(params.texels, lanes, xs[1], ys[1]), wx);
+    return lerpColors(top, bottom, wy);
+}
+
+static RS_TARGET __m128i sampleLevels(const RsDrawParams &params, uint32_t filter, const TexLevelLanes &lanes, __m128 u, __m128 v) {
+    if (filter == GL_NEAREST) {
+        return sampleNearest(params, lanes, u, v);
+    }
+    return sampleBilinear(params, lanes, u, v);
+}
+
+// Perspective correct texture coordinates at the pixels (xs, ys), divided by the interpolated 1/w
+static VGL_FORCEINLINE RS_TARGET void VGL_FASTCALL getTexCoords(const RsTriangle &tri, __m128 xs, __m128 ys, __m128 &u, __m128 &v) {
+    const __m128 w = _mm_div_ps(_mm_set_ps1(1.0f), evalPlane(tri.invW, xs, ys));
+    u = _mm_mul_ps(evalPlane(tri.texCoord[0], xs, ys), w);
+    v = _mm_mul_ps(evalPlane(tri.texCoord[1], xs, ys), w);
+}
+
+// Level of detail of the 2x2 pixel quads of a span, log2 of the longer of the texel footprint's x and y derivatives.
+// The derivatives are taken at the top left pixel of each quad, so all 4 pixels of a quad get the same level
+static RS_TARGET __m128 getQuadLod(const RsDrawParams &params, __m128 uTop, __m128 vTop, __m128 uBottom, __m128 vBottom) {
+    const __m128 sizeX = _mm_set_ps1(static_cast<float>(params.texLevels[0].size.x));
+    const __m128 sizeY = _mm_set_ps1(static_cast<float>(params.texLevels[0].size.y));
+    uTop = _mm_mul_ps(uTop, sizeX);
+    vTop = _mm_mul_ps(vTop, sizeY);
+    uBottom = _mm_mul_ps(uBottom, sizeX);
+    vBottom = _mm_mul_ps(vBottom, sizeY);
+
+    const __m128 uLeft = _mm_shuffle_ps(uTop, uTop, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 vLeft = _mm_shuffle_ps(vTop, vTop, _MM_SHUFFLE(2, 2, 0, 0));
+    const __m128 dudx = _mm_sub_ps(_mm_shuffle_ps(uTop, uTop, _MM_SHUFFLE(3, 3, 1, 1)), uLeft);
+    const __m128 dvdx = _mm_sub_ps(_mm_shuffle_ps(vTop, vTop, _MM_SHUFFLE(3, 3, 1, 1)), vLeft);
+    const __m128 dudy = _mm_sub_ps(_mm_shuffle_ps(uBottom, uBottom, _MM_SHUFFLE(2, 2, 0, 0)), uLeft);
+    const __m128 dvdy = _mm_sub_ps(_mm_shuffle_ps(vBottom, vBottom, _MM_SHUFFLE(2, 2, 0, 0)), vLeft);
+    const __m128 lengthX = _mm_add_ps(_mm_mul_ps(dudx, dudx), _mm_mul_ps(dvdx, dvdx));
+    const __m128 lengthY = _mm_add_ps(_mm_mul_ps(dudy, dudy), _mm_mul_ps(dvdy, dvdy));
+    return _mm_mul_ps(log2Ps(_mm_max_ps(lengthX, lengthY)), _mm_set_ps1(0.5f)); // of the squared lengths
+}
+
+// Samples the texture at the pixels (xs, ys) of the row y. Spans start at multiples of RS_BLOCK_SIZE, so the lanes
+// 0-1 and 2-3 are the halves of 2x2 quads, the other halves are in the row y ^ 1
+static RS_TARGET __m128i sampleTexture(const RsDrawParams &params, const RsTriangle &tri, __m128 xs, __m128 ys, int y) {
+    __m128 u, v;
+    getTexCoords(tri, xs, ys, u, v);
+    const TexLevelLanes baseLevel = getLevelLanes(params.texLevels[0]);
+    if (params.texMipFilter == GL_NONE && params.texMinFilter == params.texMagFilter) {
+        return sampleLevels(params, params.texMagFilter, baseLevel, u, v);
+    }
+
+    __m128 otherU, otherV;
+    getTexCoords(tri, xs, _mm_set_ps1(static_cast<float>(y ^ 1)), otherU, otherV);
+    const bool isTop = (y & 1) == 0;
+    const __m128 lod = getQuadLod(params, isTop ? u : otherU, isTop ? v : otherV, isTop ? otherU : u, isTop ? otherV : v);
+    const __m128 magMask = _mm_cmple_ps(lod, _mm_setzero_ps());
+    const int magLanes = _mm_movemask_ps(magMask);
+    if (magLanes == 0xF) {
+        return sampleLevels(params, params.texMagFilter, baseLevel, u, v);
+    }
+
+    __m128i color;
+    if (params.texMipFilter == GL_NONE) {
+        color = sampleLevels(params, params.texMinFilter, baseLevel, u, v);
+    }
+    else {
+        const __m128 maxLevel = _mm_set_ps1(static_cast<float>(params.texMaxLevel));
+        const __m128 clampedLod = _mm_min_ps(_mm_max_ps(lod, _mm_setzero_ps()), maxLevel);
+        if (params.texMipFilter == GL_NEAREST) {
+            const __m128i levels = _mm_cvttps_epi32(_mm_add_ps(clampedLod, _mm_set_ps1(0.5f)));
+            color = sampleLevels(params, params.texMinFilter, getLevelLanes(params, levels), u, v);
+        }
+        else {
+            // Blends the two nearest levels with 8-bit weights, lanes between the levels sample both
+            const __m128i levels = _mm_cvttps_epi32(clampedLod);
+            const __m128i weights = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(clampedLod, _mm_cvtepi32_ps(levels)), _mm_set_ps1(256.0f)));
+            color = sampleLevels(params, params.texMinFilter, getLevelLanes(params, levels), u, v);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(weights, _mm_setzero_si128())) != 0xFFFF) {
+                const __m128i nextLevels = clampEpi32(_mm_add_epi32(levels, _mm_set1_epi32(1)), _mm_setzero_si128(), _mm_set1_epi32(params.texMaxLevel));
+                color = lerpColors(color, sampleLevels(params, params.texMinFilter, getLevelLanes(params, nextLevels), u, v), weights);
+            }
+        }
+    }
+
+    // Magnified lanes are at level 0 already, only the filter may differ
+    if (magLanes != 0 && params.texMagFilter != params.texMinFilter) {
+        color = selectEpi32(_mm_castps_si128(magMask), sampleLevels(params, params.texMagFilter, baseLevel, u, v), color);
+    }
+    return color;
+}
+
+// Interpolated colors of the pixels (xs, ys) of the row y, modulated by the texture
+template<bool IsTexture>
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL shadePixels(const RsDrawParams &params, const RsTriangle &tri, __m128 xs, __m128 ys, int y) {
+    __m128i channels[4];
+    for (int i = 0; i < 4; i++) {
+        channels[i] = _mm_cvtps_epi32(evalPlane(tri.color[i], xs, ys));
+    }
+
+    // Saturating packs clamp the channels to [0, 255], the result is r0..r3 g0..g3 b0..b3 a0..a3
+    const __m128i rg = _mm_packs_epi32(channels[0], channels[1]);
+    const __m128i ba = _mm_packs_epi32(channels[2], channels[3]);
+    const __m128i planar = _mm_packus_epi16(rg, ba);
+#if RS_USE_SSE41
+    __m128i rgba = _mm_shuffle_epi8(planar, _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+#else
+    const __m128i rbga = _mm_unpacklo_epi8(planar, _mm_srli_si128(planar, 8));
+    __m128i rgba = _mm_unpacklo_epi8(rbga, _mm_srli_si128(rbga, 8));
+#endif
+    if constexpr (IsTexture) {
+        rgba = modulateColors(rgba, sampleTexture(params, tri, xs, ys, y));
+    }
+    return rgba;
+}
+
+// Shades up to RS_BLOCK_SIZE pixels of a row starting at (x, y), mask selects the covered ones.
+// Returns the mask of the pixels which passed the depth test
+template<bool IsDepthTest, uint32_t DepthFunc, bool IsDepthWrite, bool IsColorWrite, bool IsBlend, bool IsTexture, RsDepthFormat DepthFormat>
+static RS_TARGET int shadeSpan(const RsDrawParams &params, const RsTriangle &tri, int x, int y, int mask) {
+    const uint32_t idx = x + y*params.bufferSize.x;
+    const size_t colorIdx = x + static_cast<size_t>(y)*params.colorPitch;
+    const int lanesCount = Math::min(RS_BLOCK_SIZE, params.bufferSize.x - x);
+
+    const __m128 xs = _mm_add_ps(_mm_set_ps1(static_cast<float>(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    const __m128 ys = _mm_set_ps1(static_cast<float>(y));
+
+    if constexpr (IsDepthTest) {
+        __m128 z = evalPlane(tri.z, xs, ys);
+        // Keeps the depth inside the triangle's range, which the hierarchical depth culling relies on
+        z = _mm_min_ps(_mm_max_ps(z, _mm_set_ps1(tri.zMin)), _mm_set_ps1(tri.zMax));
+
+        const __m128i oldDepth = loadDepth<DepthFormat>(params.depthBuffer, idx, lanesCount);
+        const __m128i newDepth = encodeDepth<DepthFormat>(z, oldDepth);
+        mask &= depthTest<DepthFunc, DepthFormat>(newDepth, oldDepth);
+        if (mask == 0) {
+            return 0;
+        }
+
+        if constexpr (IsDepthWrite) {
+            const __m128i passed = expandMask(mask);
+#if RS_USE_SSE41
+            const __m128i depth = _mm_blendv_epi8(oldDepth, newDepth, passed);
+#else
+            const __m128i depth = _mm_or_si128(_mm_and_si128(passed, newDepth), _mm_andnot_si128(passed, oldDepth));
+#endif
+            storeDepth<DepthFormat>(params.depthBuffer, idx, lanesCount, depth);
+        }
+    }
+
+    if constexpr (IsColorWrite) {
+        const __m128i rgba = shadePixels<IsTexture>(params, tri, xs, ys, y);
+        __m128i written = _mm_and_si128(expandMask(mask), _mm_set1_epi32(params.colorMask));
+        if constexpr (IsBlend) {
+            // Fully transparent pixels leave the destination as it is with the usual alpha blending
+            if (params.blendMode == RS_BLEND_ALPHA) {
+                written = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_srli_epi32(rgba, 24), _mm_setzero_si128()), written);
+                if (_mm_movemask_epi8(written) == 0) {
+                    return mask;
+                }
+            }
+        }
+
+        if (lanesCount == RS_BLOCK_SIZE) {
+            __m128i *dst = reinterpret_cast<__m128i*>(params.colorBuffer + colorIdx);
+            const __m128i old = _mm_loadu_si128(dst);
+            __m128i color = rgba;
+            if constexpr (IsBlend) {
+                color = blendColors(params, rgba, old);
+            }
+#if RS_USE_SSE41
+            _mm_storeu_si128(dst, _mm_blendv_epi8(old, color, written));
+#else
+            _mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(written, color), _mm_andnot_si128(written, old)));
+#endif
+        }
+        else {
+            alignas(16) uint32_t colors[RS_BLOCK_SIZE];
+            alignas(16) uint32_t masks[RS_BLOCK_SIZE];
+            _mm_store_si128(reinterpret_cast<__m128i*>(colors), rgba);
+            if constexpr (IsBlend) {
+                alignas(16) uint32_t old[RS_BLOCK_SIZE] = {};
+                for (int i = 0; i < lanesCount; i++) {
+                    old[i] = params.colorBuffer[colorIdx + i].rgba;
+                }
+                const __m128i blended = blendColors(params, rgba, _mm_load_si128(reinterpret_cast<const __m128i*>(old)));
+                _mm_store_si128(reinterpret_cast<__m128i*>(colors), blended);
+            }
+            _mm_store_si128(reinterpret_cast<__m128i*>(masks), written);
+            for (int i = 0; i < lanesCount; i++) {
+                uint32_t &dst = params.colorBuffer[colorIdx + i].rgba;
+                dst = (colors[i] & masks[i]) | (dst & ~masks[i]);
+            }
+        }
+    }
+    return mask;
+}
+
+// Sample flags of up to RS_BLOCK_SIZE pixels as lane masks, the lanes past the buffer's edge are set
+static VGL_FORCEINLINE RS_TARGET __m128i VGL_FASTCALL loadSampleFlags(const uint8_t *flags, int lanesCount) {
+    uint32_t bytes = 0x01010101;
+    memcpy(&bytes, flags, lanesCount);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(bytes)), zero), zero);
+    return _mm_cmpgt_epi32(lanes, zero);
+}
+
+static VGL_FORCEINLINE RS_TARGET void VGL_FASTCALL storeSampleFlags(uint8_t *flags, int lanesCount, __m128i mask) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(_mm_and_si128(mask, _mm_set1_epi32(1)), zero), zero);
+    const uint32_t values = static_cast<uint32_t>(_mm_cvtsi128_si32(bytes));
+    memcpy(flags, &values, lanesCount);
+}
+
+// Pixels of a span with any of the samples in sampleMask
+static VGL_FORCEINLINE int getPixelMask(int sampleMask) {
+    static_assert(RS_SAMPLES_COUNT == 4 && RS_BLOCK_SIZE == 4, "Samples of a pixel are 4 bits apart");
+    return (sampleMask | (sampleMask >> 4) | (sampleMask >> 8) | (sampleMask >> 12)) & 0xF;
+}
+
+// Multisampled shadeSpan, bit s*RS_BLOCK_SIZE + i of sampleMask selects the sample s of the pixel x + i. Depth is
+// tested and written per sample, the color is computed once per pixel at its center and written to the samples
+// which passed. Pixels whose samples end up with the same color get their flag set. Returns the samples which
+// passed the depth test, in the layout of sampleMask
+template<bool IsDepthTest, uint32_t DepthFunc, bool IsDepthWrite, bool IsColorWrite, bool IsBlend, bool IsTexture, RsDepthFormat DepthFormat>
+static RS_TARGET int shadeSpanMultisample(const RsDrawParams &params, const RsTriangle &tri, int x, int y, int sampleMask) {
+    const uint32_t idx = x + y*params.bufferSize.x;
+    const int lanesCount = Math::min(RS_BLOCK_SIZE, params.bufferSize.x - x);
+
+    const __m128 xs = _mm_add_ps(_mm_set_ps1(static_cast<float>(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    const __m128 ys = _mm_set_ps1(static_cast<float>(y));
+
+    if constexpr (IsDepthTest) {
+        int passedMask = 0;
+        for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+            int mask = (sampleMask >> (s*RS_BLOCK_SIZE)) & 0xF;
+            if (mask == 0) {
+                continue;
+            }
+
+            const __m128 sampleXs = _mm_add_ps(xs, _mm_set_ps1(static_cast<float>(RS_SAMPLE_OFFSETS[s][0]) / RS_SUBPIXEL_SCALE));
+            const __m128 sampleYs = _mm_add_ps(ys, _mm_set_ps1(static_cast<float>(RS_SAMPLE_OFFSETS[s][1]) / RS_SUBPIXEL_SCALE));
+            __m128 z = evalPlane(tri.z, sampleXs, sampleYs);
+            z = _mm_min_ps(_mm_max_ps(z, _mm_set_ps1(tri.zMin)), _mm_set_ps1(tri.zMax));
+
+            const __m128i oldDepth = loadDepth<DepthFormat>(params.depthSamples[s], idx, lanesCount);
+            const __m128i newDepth = encodeDepth<DepthFormat>(z, oldDepth);
+            mask &= depthTest<DepthFunc, DepthFormat>(newDepth, oldDepth);
+            if constexpr (IsDepthWrite) {
+                if (mask != 0) {
+                    storeDepth<DepthFormat>(params.depthSamples[s], idx, lanesCount, selectEpi32(expandMask(mask), newDepth, oldDepth));
+                }
+            }
+            passedMask |= mask << (s*RS_BLOCK_SIZE);
+        }
+        sampleMask = passedMask;
+        if (sampleMask == 0) {
+            return 0;
+        }
+    }
+    const int pixelMask = getPixelMask(sampleMask);
+
+    if constexpr (IsColorWrite) {
+        const __m128i rgba = shadePixels<IsTexture>(params, tri, xs, ys, y);
+        __m128i written = _mm_set1_epi32(params.colorMask);
+        if constexpr (IsBlend) {
+            if (params.blendMode == RS_BLEND_ALPHA) {
+                written = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_srli_epi32(rgba, 24), _mm_setzero_si128()), written);
+                if (_mm_movemask_epi8(_mm_and_si128(expandMask(pixelMask), written)) == 0) {
+                    return sampleMask;
+                }
+            }
+        }
+
+        // The other samples of flagged pixels are stale, they take the color of the first one
+        const __m128i isEqual = loadSampleFlags(params.sampleFlags + idx, lanesCount);
+        const int equalLanes = _mm_movemask_ps(_mm_castsi128_ps(isEqual));
+        // Colors are loaded and stored like D32F depths, 32 bits per lane
+        __m128i old[RS_SAMPLES_COUNT];
+        old[0] = loadDepth<RS_DEPTH_D32F>(params.colorSamples[0], idx, lanesCount);
+        for (int s = 1; s < RS_SAMPLES_COUNT; s++) {
+            old[s] = (equalLanes == 0xF) ? old[0] : selectEpi32(isEqual, old[0], loadDepth<RS_DEPTH_D32F>(params.colorSamples[s], idx, lanesCount));
+        }
+
+        __m128i results[RS_SAMPLES_COUNT];
+        __m128i color = rgba;
+        for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+            if constexpr (IsBlend) {
+                if (s == 0 || equalLanes != 0xF) {
+                    color = blendColors(params, rgba, old[s]);
+                }
+            }
+            const __m128i sampleWritten = _mm_and_si128(expandMask((sampleMask >> (s*RS_BLOCK_SIZE)) & 0xF), written);
+            results[s] = selectEpi32(sampleWritten, color, old[s]);
+        }
+
+        const __m128i isResultEqual = _mm_and_si128(_mm_cmpeq_epi32(results[0], results[1]),
+                                                    _mm_and_si128(_mm_cmpeq_epi32(results[0], results[2]), _mm_cmpeq_epi32(results[0], results[3])));
+        const int validLanes = (1 << lanesCount) - 1;
+        const int resultEqualLanes = _mm_movemask_ps(_mm_castsi128_ps(isResultEqual)) & validLanes;
+        storeDepth<RS_DEPTH_D32F>(params.colorSamples[0], idx, lanesCount, results[0]);
+        if (resultEqualLanes != validLanes) {
+            for (int s = 1; s < RS_SAMPLES_COUNT; s++) {
+                storeDepth<RS_DEPTH_D32F>(params.colorSamples[s], idx, lanesCount, results[s]);
+            }
+        }
+        if (resultEqualLanes != (equalLanes & validLanes)) {
+            storeSampleFlags(params.sampleFlags + idx, lanesCount, isResultEqual);
+        }
+    }
+    return sampleMask;
+}
+
+// Recomputes the depth range of the block at (x, y) after its depth values were written, of all the samples with multisampling
+template<RsDepthFormat DepthFormat, bool IsMultisample>
+static RS_TARGET DepthRange updateHiZBlock(const RsDrawParams &params, int x, int y) {
+    __m128 minZ = _mm_set_ps1(std::numeric_limits<float>::infinity());
+    __m128 maxZ = _mm_set_ps1(-std::numeric_limits<float>::infinity());
+    const int rowsCount = Math::min(RS_BLOCK_SIZE, params.bufferSize.y - y);
+    const int lanesCount = Math::min(RS_BLOCK_SIZE, params.bufferSize.x - x);
+    constexpr int planesCount = IsMultisample ? RS_SAMPLES_COUNT : 1;
+    for (int s = 0; s < planesCount; s++) {
+        for (int r = 0; r < rowsCount; r++) {
+            __m128 z = decodeDepth<DepthFormat>(loadDepth<DepthFormat>(params.depthSamples[s], x + (y + r)*params.bufferSize.x, lanesCount));
+            if (lanesCount < RS_BLOCK_SIZE) {
+                // Lanes past the buffer's edge repeat the last valid one
+                alignas(16) float depth[RS_BLOCK_SIZE];
+                _mm_store_ps(depth, z);
+                for (int i = lanesCount; i < RS_BLOCK_SIZE; i++) {
+                    depth[i] = depth[lanesCount - 1];
+                }
+                z = _mm_load_ps(depth);
+            }
+            minZ = _mm_min_ps(minZ, z);
+            maxZ = _mm_max_ps(maxZ, z);
+        }
+    }
+    minZ = _mm_min_ps(minZ, _mm_shuffle_ps(minZ, minZ, _MM_SHUFFLE(1, 0, 3, 2)));
+    minZ = _mm_min_ps(minZ, _mm_shuffle_ps(minZ, minZ, _MM_SHUFFLE(2, 3, 0, 1)));
+    maxZ = _mm_max_ps(maxZ, _mm_shuffle_ps(maxZ, maxZ, _MM_SHUFFLE(1, 0, 3, 2)));
+    maxZ = _mm_max_ps(maxZ, _mm_shuffle_ps(maxZ, maxZ, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    DepthRange &range = params.hiZBuffer[x / RS_BLOCK_SIZE + (y / RS_BLOCK_SIZE)*params.hiZSize.x];
+    range.min = _mm_cvtss_f32(minZ);
+    range.max = _mm_cvtss_f32(maxZ);
+    return range;
+}
+
+// Half-space rasterizer. Walks the bounding box in RS_BLOCK_SIZE x RS_BLOCK_SIZE blocks stepping the edge
+// functions incrementally, rejects or accepts whole blocks by their corners and tests only the edges which
+// cross the block per pixel, RS_BLOCK_SIZE pixels at once. With depth test blocks are also culled by their
+// depth ranges, tileRange is extended by the ranges of the written blocks. With multisampling the edges are tested
+// at every sample. Adds the covered and the shaded pixels to stats
+template<bool IsDepthTest, uint32_t DepthFunc, bool IsDepthWrite, bool IsColorWrite, bool IsBlend, bool IsTexture, RsDepthFormat DepthFormat,
+         bool IsMultisample>
+static RS_TARGET void drawTriangleHalfSpace(const RsDrawParams &params, const Vec2i &clipMin, const Vec2i &clipMax, const RsTriangle &tri,
+                                            DepthRange &tileRange, RsTileStats &stats) {
+    const auto min = Vec2i::max(tri.min, clipMin);
+    const auto max = Vec2i::min(tri.max, clipMax);
+    if (min.x > max.x || min.y > max.y) {
+        return;
+    }
+
+    const int startX = min.x & ~(RS_BLOCK_SIZE - 1);
+    const int startY = min.y & ~(RS_BLOCK_SIZE - 1);
+
+    int64_t rowK[3], minOffset[3], maxOffset[3];
+    __m128i laneSteps[3];
+    for (int i = 0; i < 3; i++) {
+        const EdgeFunc &edge = tri.edges[i];
+        rowK[i] = edge.k + static_cast<int64_t>(edge.stepX)*(startX - tri.min.x) + static_cast<int64_t>(edge.stepY)*(startY - tri.min.y);
+        minOffset[i] = static_cast<int64_t>(Math::min(edge.stepX, 0) + Math::min(edge.stepY, 0))*(RS_BLOCK_SIZE - 1);
+        maxOffset[i] = static_cast<int64_t>(Math::max(edge.stepX, 0) + Math::max(edge.stepY, 0))*(RS_BLOCK_SIZE - 1);
+        laneSteps[i] = _mm_setr_epi32(0, edge.stepX, edge.stepX*2, edge.stepX*3);
+        if constexpr (IsMultisample) {
+            // Blocks are accepted or rejected by the samples of their corner pixels
+            int32_t minSampleOffset = edge.sampleOffsets[0];
+            int32_t maxSampleOffset = edge.sampleOffsets[0];
+            for (int s = 1; s < RS_SAMPLES_COUNT; s++) {
+                minSampleOffset = Math::min(minSampleOffset, edge.sampleOffsets[s]);
+                maxSampleOffset = Math::max(maxSampleOffset, edge.sampleOffsets[s]);
+            }
+            minOffset[i] += minSampleOffset;
+            maxOffset[i] += maxSampleOffset;
+        }
+    }
+
+    uint32_t testedCount = 0;
+    uint32_t shadedCount = 0;
+    uint32_t samplesCount = 0;
+    for (int by = startY; by <= max.y; by += RS_BLOCK_SIZE) {
+        int64_t blockK[3] = { rowK[0], rowK[1], rowK[2] };
+
+        for (int bx = startX; bx <= max.x; bx += RS_BLOCK_SIZE) {
+            bool isRejected = false;
+            int partialEdges[3];
+            int partialCount = 0;
+            for (int i = 0; i < 3; i++) {
+                if (blockK[i] + maxOffset[i] < 0) {
+                    isRejected = true;
+                    break;
+                }
+                if (blockK[i] + minOffset[i] < 0) {
+                    partialEdges[partialCount++] = i;
+                }
+            }
+
+            if constexpr (IsDepthTest) {
+                if (!isRejected) {
+                    const DepthRange &blockRange = params.hiZBuffer[bx / RS_BLOCK_SIZE + (by / RS_BLOCK_SIZE)*params.hiZSize.x];
+                    isRejected = isDepthRangeOccluded<DepthFunc>(tri.zMin, tri.zMax, blockRange);
+                }
+            }
+
+            if (!isRejected) {
+                int clipMask = 0xF;
+                if (bx < min.x) {
+                    clipMask &= 0xF << (min.x - bx);
+                }
+                if (bx + RS_BLOCK_SIZE - 1 > max.x) {
+                    clipMask &= 0xF >> (bx + RS_BLOCK_SIZE - 1 - max.x);
+                }
+
+                const int rowStart = Math::max(by, min.y) - by;
+                const int rowEnd = Math::min(by + RS_BLOCK_SIZE - 1, max.y) - by;
+                int shadedMask = 0;
+                // Edges which cross the block are bounded by the block size, so they fit in 32 bits
+                for (int r = rowStart; r <= rowEnd; r++) {
+                    if constexpr (IsMultisample) {
+                        int sampleMask = clipMask*0x1111;
+                        for (int j = 0; j < partialCount; j++) {
+                            const int e = partialEdges[j];
+                            const int32_t k = static_cast<int32_t>(blockK[e] + static_cast<int64_t>(tri.edges[e].stepY)*r);
+                            const __m128i ks = _mm_add_epi32(_mm_set1_epi32(k), laneSteps[e]);
+                            for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+                                const __m128i sampleKs = _mm_add_epi32(ks, _mm_set1_epi32(tri.edges[e].sampleOffsets[s]));
+                                sampleMask &= ~(_mm_movemask_ps(_mm_castsi128_ps(sampleKs)) << (s*RS_BLOCK_SIZE));
+                            }
+                        }
+
+                        if (sampleMask != 0) {
+                            testedCount += gBitsCount[getPixelMask(sampleMask)];
+                            const int rowSampleMask = shadeSpanMultisample<IsDepthTest, DepthFunc, IsDepthWrite, IsColorWrite, IsBlend, IsTexture, DepthFormat>(
+                                params, tri, bx, by + r, sampleMask);
+                            const int rowShadedMask = getPixelMask(rowSampleMask);
+                            shadedCount += gBitsCount[rowShadedMask];
+                            for (int s = 0; s < RS_SAMPLES_COUNT; s++) {
+                                samplesCount += gBitsCount[(rowSampleMask >> (s*RS_BLOCK_SIZE)) & 0xF];
+                            }
+                            shadedMask |= rowShadedMask;
+                        }
+                    }
+                    else {
+                        int mask = clipMask;
+
+                        for (int j = 0; j < partialCount; j++) {
+                            const int e = partialEdges[j];
+                            const int32_t k = static_cast<int32_t>(blockK[e] + static_cast<int64_t>(tri.edges[e].stepY)*r);
+                            __m128i ks = _mm_add_epi32(_mm_set1_epi32(k), laneSteps[e]);
+                            mask &= ~_mm_movemask_ps(_mm_castsi128_ps(ks));
+                        }
+
+                        if (mask != 0) {
+                            testedCount += gBitsCount[mask];
+                            const int rowShadedMask = shadeSpan<IsDepthTest, DepthFunc, IsDepthWrite, IsColorWrite, IsBlend, IsTexture, DepthFormat>(params, tri, bx, by + r, mask);
+                            shadedCount += gBitsCount[rowShadedMask];
+                            shadedMask |= rowShadedMask;
+                        }
+                    }
+                }
+
+                if constexpr (IsDepthTest && IsDepthWrite) {
+                    if (shadedMask != 0) {
+                        const DepthRange blockRange = updateHiZBlock<DepthFormat, IsMultisample>(params, bx, by);
+                        tileRange.min = Math::min(tileRange.min, blockRange.min);
+                        tileRange.max = Math::max(tileRange.max, blockRange.max);
+                    }
+                }
+            }
+
+            for (int i = 0; i < 3; i++) {
+                blockK[i] += static_cast<int64_t>(tri.edges[i].stepX)*RS_BLOCK_SIZE;
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            rowK[i] += static_cast<int64_t>(tri.edges[i].stepY)*RS_BLOCK_SIZE;
+        }
+    }
+    stats.pixelsTested += testedCount;
+    stats.pixelsPassed += shadedCount;
+    stats.samplesPassed += IsMultisample ? samplesCount : shadedCount;
+}
+
+// Rasterizes the binned triangles of one tile
+template<bool IsDepthTest, uint32_t DepthFunc, bool IsDepthWrite, bool IsColorWrite, bool IsBlend, bool IsTexture, RsDepthFormat DepthFormat,
+         bool IsMultisample>
+static RS_TARGET RsTileStats rasterizeTile(const RsDrawParams &params, uint32_t tileIdx) {
+    const auto tilePos = Vec2i(tileIdx % params.tilesCount.x, tileIdx / params.tilesCount.x);
+    const auto tileMin = Vec2i::max(params.bufferMin + tilePos*RS_TILE_SIZE, params.vpMin);
+    const auto tileMax = Vec2i::min(params.bufferMin + tilePos*RS_TILE_SIZE + Vec2i(RS_TILE_SIZE - 1), params.vpMax);
+
+    // Envelope of the depth ranges of the tile's blocks. Written blocks only extend it, so it stays conservative
+    auto tileRange = DepthRange{ std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+    if constexpr (IsDepthTest) {
+        const auto hiZMin = Vec2i((tileMin.x - params.bufferMin.x) / RS_BLOCK_SIZE, (tileMin.y - params.bufferMin.y) / RS_BLOCK_SIZE);
+        const auto hiZMax = Vec2i((tileMax.x - params.bufferMin.x) / RS_BLOCK_SIZE, (tileMax.y - params.bufferMin.y) / RS_BLOCK_SIZE);
+        for (int y = hiZMin.y; y <= hiZMax.y; y++) {
+            for (int x = hiZMin.x; x <= hiZMax.x; x++) {
+                const DepthRange &blockRange = params.hiZBuffer[x + y*params.hiZSize.x];
+                tileRange.min = Math::min(tileRange.min, blockRange.min);
+                tileRange.max = Math::max(tileRange.max, blockRange.max);
+            }
+        }
+    }
+
+    RsTileStats stats = {};
+    for (uint32_t triIdx : params.tileBins[tileIdx]) {
+        const RsTriangle &tri = params.triangles[triIdx];
+        if constexpr (IsDepthTest) {
+            if (isDepthRangeOccluded<DepthFunc>(tri.zMin, tri.zMax, tileRange)) {
+                continue;
+            }
+        }
+        drawTriangleHalfSpace<IsDepthTest, DepthFunc, IsDepthWrite, IsColorWrite, IsBlend, IsTexture, DepthFormat, IsMultisample>(
+            params, tileMin, tileMax, tri, tileRange, stats);
+    }
+    return stats;
+}
+
+// Without depth test the depth func, depth write and depth format don't matter, so those entries share the kernels.
+// Blending and texturing only matter with color write, multisampling always does
+template<size_t Idx>
+static constexpr RsTileFunc makeTileFunc() {
+    constexpr bool isColorWrite = Idx & 1;
+    constexpr bool isDepthWrite = (Idx >> 1) & 1;
+    constexpr uint32_t depthFunc = gDepthFuncs[(Idx >> 2) & 7];
+    constexpr bool isDepthTest = (Idx >> 5) & 1;
+    constexpr bool isBlend = isColorWrite && ((Idx >> 6) & 1);
+    constexpr bool isTexture = isColorWrite && ((Idx >> 7) & 1);
+    constexpr auto depthFormat = static_cast<RsDepthFormat>((Idx >> 8) % RS_DEPTH_FORMATS_COUNT);
+    constexpr bool isMultisample = (Idx >> 8) >= RS_DEPTH_FORMATS_COUNT;
+    if constexpr (isDepthTest) {
+        return &rasterizeTile<true, depthFunc, isDepthWrite, isColorWrite, isBlend, isTexture, depthFormat, isMultisample>;
+    }
+    else {
+        return &rasterizeTile<false, GL_ALWAYS, false, isColorWrite, isBlend, isTexture, RS_DEPTH_D32F, isMultisample>;
+    }
+}
+
+template<size_t... Idx>
+static constexpr std::array<RsTileFunc, sizeof...(Idx)> makeTileFuncs(std::index_sequence<Idx...>) {
+    return { makeTileFunc<Idx>()... };
+}
+
+static constexpr auto gTileFuncs = makeTileFuncs(std::make_index_sequence<RS_TILE_FUNCS_COUNT>());
@@ -0,0 +1,8 @@
+#define RS_TARGET VGL_TARGET_SSE2
+#define RS_USE_SSE41 0
+#define RS_USE_AVX2 0
+#include "RasterizerKernels.inl"
+
+const RsTileFunc *rsGetTileFuncsSSE2() {
+    return gTileFuncs.data();
+}
@@ -0,0 +1,8 @@
+#define RS_TARGET VGL_TARGET_SSE41
+#define RS_USE_SSE41 1
+#define RS_USE_AVX2 0
+#include "RasterizerKernels.inl"
+
+const RsTileFunc *rsGetTileFuncsSSE41() {
+    return gTileFuncs.data();
+}
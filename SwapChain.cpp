@@ -0,0 +1,76 @@
+#include "SwapChain.hpp"
+
+void SwapChain::setBuffers(int count, int width, int height) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mReleaseCond.wait(lock, [this] {
+        for (const Buffer &buffer : mBuffers) {
+            if (buffer.readersCount > 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    mBuffers.resize(count);
+    mWidth = width;
+    for (Buffer &buffer : mBuffers) {
+        buffer.pixels.resize(static_cast<size_t>(width)*height);
+        buffer.frame = 0;
+    }
+    mBackIdx = 0;
+    mLatestIdx = -1;
+}
+
+int SwapChain::getCount() const {
+    return static_cast<int>(mBuffers.size());
+}
+
+Color *SwapChain::getBackBuffer() {
+    return mBuffers[mBackIdx].pixels.data();
+}
+
+void SwapChain::present() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mBuffers[mBackIdx].frame = ++mPresentedCount;
+    mLatestIdx = mBackIdx;
+
+    // The oldest frame which isn't read, the latest one stays readable
+    int nextIdx = -1;
+    mReleaseCond.wait(lock, [this, &nextIdx] {
+        for (int i = 0; i < getCount(); i++) {
+            const Buffer &buffer = mBuffers[i];
+            if (i != mLatestIdx && buffer.readersCount == 0 && (nextIdx < 0 || buffer.frame < mBuffers[nextIdx].frame)) {
+                nextIdx = i;
+            }
+        }
+        return nextIdx >= 0;
+    });
+    mBuffers[nextIdx].frame = 0;
+    mBackIdx = nextIdx;
+}
+
+bool SwapChain::acquireLatest(const Color *&buffer, int &width, uint64_t &frame) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mLatestIdx < 0) {
+        return false;
+    }
+    Buffer &latest = mBuffers[mLatestIdx];
+    latest.readersCount++;
+    buffer = latest.pixels.data();
+    width = mWidth;
+    frame = latest.frame;
+    return true;
+}
+
+void SwapChain::release(uint64_t frame) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (Buffer &buffer : mBuffers) {
+            if (buffer.frame == frame && buffer.readersCount > 0) {
+                buffer.readersCount--;
+                break;
+            }
+        }
+    }
+    mReleaseCond.notify_all();
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "Math.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Color buffers of a context taking turns as the back buffer, which is drawn into, and the completed frames, which
+// other threads read. Presenting picks the next back buffer among the ones nobody reads, leaving the latest
+// completed frame alone, so with 3 buffers drawing never waits for a single reader
+class SwapChain {
+public:
+    SwapChain() = default;
+
+    SwapChain(const SwapChain&) = delete;
+    SwapChain &operator=(const SwapChain&) = delete;
+
+    // Waits until no frame is acquired, count 0 releases the buffers
+    void setBuffers(int count, int width, int height);
+    int getCount() const;
+
+    Color *getBackBuffer();
+
+    // Makes the back buffer the latest completed frame. Waits while every other buffer is acquired
+    void present();
+
+    // Acquires the latest completed frame without waiting, its buffer isn't drawn into until it's released.
+    // Frames are numbered from 1 in presentation order, false before the first one
+    bool acquireLatest(const Color *&buffer, int &width, uint64_t &frame);
+    void release(uint64_t frame);
+
+private:
+    struct Buffer {
+        std::vector<Color> pixels;
+        uint64_t frame = 0; // presented in it, 0 for none
+        int readersCount = 0;
+    };
+
+    std::mutex mMutex;
+    std::condition_variable mReleaseCond;
+    std::vector<Buffer> mBuffers;
+    int mWidth = 0;
+    int mBackIdx = 0;
+    int mLatestIdx = -1;
+    uint64_t mPresentedCount = 0;
+};
@@ -0,0 +1,110 @@
+#include "Texture.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <cstring>
+
+static bool isSizeEqual(const Vec2i &a, const Vec2i &b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+static Vec2i getNextMipSize(const Vec2i &size) {
+    return Vec2i::max(Vec2i(size.x >> 1, size.y >> 1), Vec2i(1, 1));
+}
+
+void TextureImage::setLevelSizes(const std::vector<Vec2i> &sizes) {
+    std::vector<TextureLevel> newLevels(sizes.size());
+    uint32_t offset = 0;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        newLevels[i].setSize(sizes[i], offset);
+        offset += newLevels[i].texelsCount;
+    }
+
+    std::vector<Color> newTexels(offset, Color(0, 0, 0, 0));
+    for (size_t i = 0; i < std::min(this->levels.size(), newLevels.size()); i++) {
+        const TextureLevel &level = this->levels[i];
+        if (isSizeEqual(level.size, newLevels[i].size) && level.texelsCount != 0) {
+            memcpy(&newTexels[newLevels[i].offset], &this->texels[level.offset], level.texelsCount*sizeof(Color));
+        }
+    }
+    this->levels = std::move(newLevels);
+    this->texels = std::move(newTexels);
+}
+
+void TextureImage::setLevelSize(int level, const Vec2i &size) {
+    if (static_cast<size_t>(level) < this->levels.size() && isSizeEqual(this->levels[level].size, size)) {
+        return;
+    }
+    std::vector<Vec2i> sizes(std::max(this->levels.size(), static_cast<size_t>(level + 1)), Vec2i(0, 0));
+    for (size_t i = 0; i < this->levels.size(); i++) {
+        sizes[i] = this->levels[i].size;
+    }
+    sizes[level] = size;
+    setLevelSizes(sizes);
+}
+
+int TextureImage::getMipLevelsCount() const {
+    if (this->levels.empty() || this->levels[0].isEmpty()) {
+        return 0;
+    }
+    int count = 1;
+    while (count < static_cast<int>(this->levels.size())) {
+        const Vec2i &prevSize = this->levels[count - 1].size;
+        if ((prevSize.x == 1 && prevSize.y == 1) || !isSizeEqual(this->levels[count].size, getNextMipSize(prevSize))) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+// A level one texel wide or high is averaged with its copy, which goes to the padding next to it
+static void replicateEdges(TextureImage &image, int level) {
+    const Vec2i size = image.levels[level].size;
+    if (size.x == 1) {
+        for (int y = 0; y < size.y; y++) {
+            image.setTexel(level, 1, y, image.getTexel(level, 0, y));
+        }
+    }
+    if (size.y == 1) {
+        for (int x = 0; x < size.x + (size.x == 1); x++) {
+            image.setTexel(level, x, 1, image.getTexel(level, x, 0));
+        }
+    }
+}
+
+// 2x2 box filter with rounding. An aligned 2x2 block of texels is 4 consecutive ones in the Morton order, so every
+// 16 source texels make 4 destination ones, which are consecutive as well. Odd sizes drop the last row or column
+static void downsampleLevel(const TextureLevel &src, const TextureLevel &dst, Color *texels) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(2);
+    for (int qy = 0; qy < (dst.size.y + 1) / 2; qy++) {
+        for (int qx = 0; qx < (dst.size.x + 1) / 2; qx++) {
+            const __m128i *srcBlock = reinterpret_cast<const __m128i*>(&texels[src.getTexelIndex(qx*4, qy*4)]);
+            __m128i sums[4];
+            for (int i = 0; i < 4; i++) {
+                const __m128i quad = _mm_loadu_si128(srcBlock + i);
+                sums[i] = _mm_add_epi16(_mm_unpacklo_epi8(quad, zero), _mm_unpackhi_epi8(quad, zero));
+            }
+            const __m128i sums01 = _mm_add_epi16(_mm_unpacklo_epi64(sums[0], sums[1]), _mm_unpackhi_epi64(sums[0], sums[1]));
+            const __m128i sums23 = _mm_add_epi16(_mm_unpacklo_epi64(sums[2], sums[3]), _mm_unpackhi_epi64(sums[2], sums[3]));
+            const __m128i result = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(sums01, round), 2), _mm_srli_epi16(_mm_add_epi16(sums23, round), 2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[dst.getTexelIndex(qx*2, qy*2)]), result);
+        }
+    }
+}
+
+void TextureImage::generateMipmaps() {
+    if (this->levels.empty() || this->levels[0].isEmpty()) {
+        return;
+    }
+    std::vector<Vec2i> sizes = { this->levels[0].size };
+    while (sizes.back().x > 1 || sizes.back().y > 1) {
+        sizes.push_back(getNextMipSize(sizes.back()));
+    }
+    setLevelSizes(sizes);
+
+    for (size_t i = 1; i < this->levels.size(); i++) {
+        replicateEdges(*this, static_cast<int>(i - 1));
+        downsampleLevel(this->levels[i - 1], this->levels[i], this->texels.data());
+    }
+}
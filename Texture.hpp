@@ -0,0 +1,70 @@
+#pragma once
+#include "Math.hpp"
+#include <vector>
+
+// Texels are stored in TEX_TILE_SIZE x TEX_TILE_SIZE tiles, one row of tiles after another. Inside a tile they
+// follow the Morton (Z) order, so the footprint of a bilinear sample and the texels of neighbouring pixels
+// mostly share cache lines whichever direction the texture is walked in. Levels are padded to whole tiles
+constexpr int TEX_TILE_BITS = 3;
+constexpr int TEX_TILE_SIZE = 1 << TEX_TILE_BITS;
+constexpr int TEX_MAX_SIZE = 8192;
+constexpr int TEX_MAX_LEVELS = 14; // down to 1x1 from TEX_MAX_SIZE
+
+// Moves the bits 0, 1, 2 of v to the bits 0, 2, 4, the Morton code of (x, y) is spread(x) | spread(y) << 1
+constexpr uint32_t texSpreadBits(uint32_t v) {
+    v = (v | (v << 2)) & 0x33;
+    return (v | (v << 1)) & 0x55;
+}
+
+// One mip level inside TextureImage::texels
+struct TextureLevel {
+    Vec2i size = Vec2i(0, 0);
+    int tilesPerRow = 0;
+    uint32_t offset = 0; // of the first texel
+    uint32_t texelsCount = 0; // including the padding
+
+    void setSize(const Vec2i &size, uint32_t offset) {
+        this->size = size;
+        this->tilesPerRow = (size.x + TEX_TILE_SIZE - 1) >> TEX_TILE_BITS;
+        const int tilesPerColumn = (size.y + TEX_TILE_SIZE - 1) >> TEX_TILE_BITS;
+        this->offset = offset;
+        this->texelsCount = static_cast<uint32_t>(this->tilesPerRow*tilesPerColumn*TEX_TILE_SIZE*TEX_TILE_SIZE);
+    }
+
+    bool isEmpty() const {
+        return this->size.x == 0 || this->size.y == 0;
+    }
+
+    uint32_t getTexelIndex(int x, int y) const {
+        const uint32_t tile = (y >> TEX_TILE_BITS)*this->tilesPerRow + (x >> TEX_TILE_BITS);
+        const uint32_t mask = TEX_TILE_SIZE - 1;
+        return this->offset + ((tile << (2*TEX_TILE_BITS)) | texSpreadBits(x & mask) | (texSpreadBits(y & mask) << 1));
+    }
+};
+
+// Mip levels of a texture, texels are RGBA8. All levels share one allocation, so the kernels can sample
+// different levels in the lanes of one SIMD register from a single base pointer
+struct TextureImage {
+    std::vector<TextureLevel> levels; // level 0 is the base image
+    std::vector<Color> texels;
+
+    // Reallocates the level, the texels of the other levels are kept and the level is cleared
+    void setLevelSize(int level, const Vec2i &size);
+
+    // Replaces the levels above 0 by the box filtered chain down to 1x1
+    void generateMipmaps();
+
+    // Number of levels from 0 which form a mip chain, each half the size of the previous one
+    int getMipLevelsCount() const;
+
+    Color getTexel(int level, int x, int y) const {
+        return this->texels[this->levels[level].getTexelIndex(x, y)];
+    }
+
+    void setTexel(int level, int x, int y, const Color &color) {
+        this->texels[this->levels[level].getTexelIndex(x, y)] = color;
+    }
+
+private:
+    void setLevelSizes(const std::vector<Vec2i> &sizes);
+};
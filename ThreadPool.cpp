@@ -0,0 +1,105 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(int threadCount) {
+    setThreadCount(threadCount);
+}
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+void ThreadPool::setThreadCount(int threadCount) {
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    if (threadCount != getThreadCount()) {
+        stopWorkers();
+        startWorkers(threadCount - 1);
+    }
+}
+
+int ThreadPool::getThreadCount() const {
+    return static_cast<int>(mWorkers.size()) + 1;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &func) {
+    if (count == 0) {
+        return;
+    }
+    if (mWorkers.empty() || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    {
+        // Workers which woke up late for the previous job may still be inside runJobs()
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCond.wait(lock, [this] { return mActiveCount == 0; });
+        mFunc = &func;
+        mCount = count;
+        mNextIdx = 0;
+        mDoneCount = 0;
+        mGeneration++;
+    }
+    mWakeCond.notify_all();
+
+    runJobs();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCond.wait(lock, [this] { return mDoneCount == mCount; });
+}
+
+void ThreadPool::startWorkers(int workersCount) {
+    mIsStopping = false;
+    mWorkers.reserve(workersCount);
+    for (int i = 0; i < workersCount; i++) {
+        mWorkers.emplace_back(&ThreadPool::workerMain, this);
+    }
+}
+
+void ThreadPool::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIsStopping = true;
+    }
+    mWakeCond.notify_all();
+    for (auto &worker : mWorkers) {
+        worker.join();
+    }
+    mWorkers.clear();
+}
+
+void ThreadPool::workerMain() {
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeCond.wait(lock, [this, generation] { return mIsStopping || mGeneration != generation; });
+            if (mIsStopping) {
+                return;
+            }
+            generation = mGeneration;
+            mActiveCount++;
+        }
+        runJobs();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mActiveCount--;
+        }
+        mDoneCond.notify_all();
+    }
+}
+
+void ThreadPool::runJobs() {
+    size_t finished = 0;
+    for (size_t i = mNextIdx++; i < mCount; i = mNextIdx++) {
+        (*mFunc)(i);
+        finished++;
+    }
+    if (finished > 0 && (mDoneCount += finished) == mCount) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDoneCond.notify_all();
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+class ThreadPool {
+public:
+    ThreadPool() = default;
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+
+    // Total number of threads, including the calling one
+    void setThreadCount(int threadCount);
+    int getThreadCount() const;
+
+    // Calls func(i) for every i in [0, count) and returns when all calls are done.
+    // The calling thread takes part in the work.
+    void parallelFor(size_t count, const std::function<void(size_t)> &func);
+
+private:
+    void startWorkers(int workersCount);
+    void stopWorkers();
+    void workerMain();
+    void runJobs();
+
+    std::vector<std::thread> mWorkers;
+    std::mutex mMutex;
+    std::condition_variable mWakeCond;
+    std::condition_variable mDoneCond;
+    bool mIsStopping = false;
+    uint64_t mGeneration = 0;
+    int mActiveCount = 0;
+
+    const std::function<void(size_t)> *mFunc = nullptr;
+    size_t mCount = 0;
+    std::atomic<size_t> mNextIdx = 0;
+    std::atomic<size_t> mDoneCount = 0;
+};
@@ -1,16 +1,26 @@
 #include "VGL.hpp"
 #include "VGLInternal.hpp"
 #include "Rasterizer.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
 
-GLContext *gCurrentContext = nullptr;
+thread_local GLContext *gCurrentContext = nullptr;
 
-GLContext *vglContextCreate(int w, int h) {
+static_assert(static_cast<int>(VGL_DEPTH_D32F) == RS_DEPTH_D32F && static_cast<int>(VGL_DEPTH_D24S8) == RS_DEPTH_D24S8 &&
+              static_cast<int>(VGL_DEPTH_D16) == RS_DEPTH_D16, "Depth formats must match");
+
+GLContext *vglContextCreate(int w, int h, VGLDepthFormat depthFormat) {
     auto ctx = new GLContext();
+    ctx->depthFormat = static_cast<RsDepthFormat>(depthFormat);
     vglContextResizeBuffers(ctx, w, h);
+    vglContextSetThreadCount(ctx, static_cast<int>(std::thread::hardware_concurrency()));
     return ctx;
 }
 
 void vglContextDestroy(GLContext *ctx) {
+    ctx->commandQueue.setEnabled(ctx, false);
     if (gCurrentContext == ctx) {
         vglContextMakeCurrent(nullptr);
     }
@@ -18,28 +28,262 @@ void vglContextDestroy(GLContext *ctx) {
 }
 
 void vglContextMakeCurrent(GLContext *ctx) {
-    if (ctx) {
-        gCurrentContext = ctx;
-        gCurrentState = &ctx->state;
-        rsSetFramebuffer(ctx->bufferRect, ctx->colorBufferData.data(), ctx->depthBufferData.data());
+    gCurrentContext = ctx;
+    gCurrentState = ctx ? &ctx->state : nullptr;
+}
+
+// Depth values are unknown until the first clear, so the ranges must not cull anything
+static void resetHiZBuffer(GLContext *ctx) {
+    std::fill(ctx->hiZBufferData.begin(), ctx->hiZBufferData.end(),
+              DepthRange{ -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() });
+}
+
+static void updateFramebuffer(GLContext *ctx) {
+    Color *colorBuffer = ctx->externalColorBuffer ? ctx->externalColorBuffer :
+                         ctx->swapChain.getCount() ? ctx->swapChain.getBackBuffer() : ctx->colorBufferData.data();
+    const int colorPitch = ctx->externalColorBuffer ? ctx->externalColorPitch : ctx->bufferRect.getSize().x;
+    void *depthBuffer = ctx->externalDepthBuffer ? ctx->externalDepthBuffer : ctx->depthBufferData.data();
+    rsSetFramebuffer(ctx->rasterizer, ctx->bufferRect, colorBuffer, colorPitch, depthBuffer, ctx->depthFormat, ctx->hiZBufferData.data());
+    if (ctx->samplesCount > 1) {
+        rsSetSampleBuffers(ctx->rasterizer, ctx->colorSampleData.data(), ctx->sampleFlagData.data(), ctx->depthSampleData.data());
     }
     else {
-        gCurrentContext = nullptr;
-        gCurrentState = nullptr;
-        rsSetFramebuffer(IntRect(0, 0, 0, 0), nullptr, nullptr);
+        rsSetSampleBuffers(ctx->rasterizer, nullptr, nullptr, nullptr);
+    }
+}
+
+// Sample buffers with the flags set, so only the first color sample counts
+static void allocateSampleBuffers(GLContext *ctx) {
+    const size_t area = ctx->bufferRect.getArea();
+    ctx->colorSampleData.resize(area*RS_SAMPLES_COUNT);
+    ctx->sampleFlagData.assign(area, 1);
+    ctx->depthSampleData.resize(((RS_SAMPLES_COUNT - 1)*area*rsGetDepthFormatSize(ctx->depthFormat) + 3) / 4);
+}
+
+// Writes the pending clears and the resolved samples
+static void resolveColorBuffer(GLContext *ctx) {
+    rsResolveClears(ctx, RS_CLEAR_COLOR);
+    if (ctx->samplesCount > 1) {
+        rsResolveSamples(ctx);
     }
 }
 
 void vglContextResizeBuffers(GLContext *ctx, int w, int h) {
+    ctx->commandQueue.finish();
     auto size = ctx->bufferRect.getSize();
     if (size.x != w || size.y != h) {
         ctx->bufferRect.setSized(0, 0, w, h);
-        ctx->colorBufferData.resize(w*h);
-        ctx->depthBufferData.resize(w*h);
+        if (ctx->swapChain.getCount()) {
+            ctx->swapChain.setBuffers(ctx->swapChain.getCount(), w, h);
+        }
+        else {
+            ctx->colorBufferData.resize(w*h);
+        }
+        ctx->depthBufferData.resize((w*h*rsGetDepthFormatSize(ctx->depthFormat) + 3) / 4);
+        ctx->externalColorBuffer = nullptr;
+        ctx->externalDepthBuffer = nullptr;
+        if (ctx->samplesCount > 1) {
+            allocateSampleBuffers(ctx);
+        }
+
+        auto hiZSize = rsGetHiZSize(Vec2i(w, h));
+        ctx->hiZBufferData.resize(hiZSize.x*hiZSize.y);
+        resetHiZBuffer(ctx);
+        auto tilesCount = rsGetTilesCount(Vec2i(w, h));
+        ctx->tileClearFlags.assign(tilesCount.x*tilesCount.y, 0);
+        updateFramebuffer(ctx);
     }
 }
 
 void vglContextGetColorBuffer(GLContext *ctx, void *&colorBuffer, int &pitch) {
-    colorBuffer = ctx->colorBufferData.data();
-    pitch = ctx->bufferRect.getSize().x*sizeof(ctx->colorBufferData[0]);
+    ctx->commandQueue.finish();
+    resolveColorBuffer(ctx);
+    colorBuffer = ctx->rasterizer.colorBuffer;
+    pitch = ctx->rasterizer.colorPitch*sizeof(Color);
+}
+
+void vglContextGetDepthBuffer(GLContext *ctx, const void *&depthBuffer, int &pitch) {
+    ctx->commandQueue.finish();
+    rsResolveClears(ctx, RS_CLEAR_DEPTH);
+    depthBuffer = ctx->rasterizer.depthBuffer;
+    pitch = ctx->bufferRect.getSize().x*rsGetDepthFormatSize(ctx->depthFormat);
+}
+
+void vglContextSetExternalBuffers(GLContext *ctx, void *colorBuffer, int colorPitch, void *depthBuffer) {
+    if (colorBuffer && (colorPitch < ctx->bufferRect.getSize().x*static_cast<int>(sizeof(Color)) || colorPitch % sizeof(Color) != 0)) {
+        return;
+    }
+
+    ctx->commandQueue.finish();
+    ctx->externalColorBuffer = static_cast<Color*>(colorBuffer);
+    ctx->externalColorPitch = colorBuffer ? colorPitch / static_cast<int>(sizeof(Color)) : 0;
+    ctx->externalDepthBuffer = depthBuffer;
+    const void *prevDepthBuffer = ctx->rasterizer.depthBuffer;
+    updateFramebuffer(ctx);
+    // The ranges described the previous depth buffer
+    if (ctx->rasterizer.depthBuffer != prevDepthBuffer) {
+        resetHiZBuffer(ctx);
+    }
+}
+
+VGLDepthFormat vglContextGetDepthFormat(GLContext *ctx) {
+    return static_cast<VGLDepthFormat>(ctx->depthFormat);
+}
+
+void vglContextSetThreadCount(GLContext *ctx, int count) {
+    ctx->commandQueue.finish();
+    ctx->threadPool.setThreadCount(count);
+}
+
+void vglContextSetSampleCount(GLContext *ctx, int count) {
+    ctx->commandQueue.finish();
+    if ((count != 1 && count != RS_SAMPLES_COUNT) || count == ctx->samplesCount) {
+        return;
+    }
+
+    // The samples start from the buffers' contents, the depth buffer keeps the first depth sample in both modes
+    const RsContext &rs = ctx->rasterizer;
+    if (count > 1) {
+        rsResolveClears(ctx, RS_CLEAR_COLOR | RS_CLEAR_DEPTH);
+        allocateSampleBuffers(ctx);
+        const Vec2i size = ctx->bufferRect.getSize();
+        for (int y = 0; y < size.y; y++) {
+            std::copy_n(rs.colorBuffer + static_cast<size_t>(y)*rs.colorPitch, size.x, ctx->colorSampleData.data() + static_cast<size_t>(y)*size.x);
+        }
+        const size_t depthPlaneSize = ctx->bufferRect.getArea()*rsGetDepthFormatSize(ctx->depthFormat);
+        for (int s = 1; s < RS_SAMPLES_COUNT; s++) {
+            memcpy(reinterpret_cast<uint8_t*>(ctx->depthSampleData.data()) + (s - 1)*depthPlaneSize, rs.depthBuffer, depthPlaneSize);
+        }
+    }
+    else {
+        resolveColorBuffer(ctx);
+        ctx->colorSampleData = std::vector<Color>();
+        ctx->sampleFlagData = std::vector<uint8_t>();
+        ctx->depthSampleData = std::vector<uint32_t>();
+    }
+    ctx->samplesCount = count;
+    updateFramebuffer(ctx);
+}
+
+void vglContextSetFastClear(GLContext *ctx, bool isEnabled) {
+    ctx->commandQueue.finish();
+    if (!isEnabled) {
+        rsResolveClears(ctx, RS_CLEAR_COLOR | RS_CLEAR_DEPTH);
+    }
+    ctx->isFastClear = isEnabled;
+}
+
+void vglContextGetStats(GLContext *ctx, VGLStats &stats) {
+    ctx->commandQueue.finish();
+    uint64_t counters[GL_COUNTERS_COUNT];
+    for (int i = 0; i < GL_COUNTERS_COUNT; i++) {
+        counters[i] = ctx->counters[i] - ctx->countersBase[i];
+    }
+
+    stats.verticesSubmitted = counters[GL_COUNTER_VERTICES_SUBMITTED];
+    stats.verticesTransformed = counters[GL_COUNTER_VERTICES_TRANSFORMED];
+    stats.vertexCacheHits = counters[GL_COUNTER_VERTEX_CACHE_HITS];
+    stats.trianglesSubmitted = counters[GL_COUNTER_TRIANGLES_SUBMITTED];
+    stats.trianglesClipped = counters[GL_COUNTER_TRIANGLES_CLIPPED];
+    stats.trianglesCulled = counters[GL_COUNTER_TRIANGLES_CULLED];
+    stats.trianglesRasterized = counters[GL_COUNTER_TRIANGLES_RASTERIZED];
+    stats.pixelsTested = counters[GL_COUNTER_PIXELS_TESTED];
+    stats.pixelsPassed = counters[GL_COUNTER_PIXELS_PASSED];
+    stats.samplesPassed = counters[GL_COUNTER_SAMPLES_PASSED];
+
+    const int area = ctx->bufferRect.getArea();
+    stats.overdraw = area ? static_cast<double>(stats.pixelsPassed) / area : 0.0;
+
+    stats.times.vertex = ctx->stageTimes[GL_STAGE_VERTEX];
+    stats.times.setup = ctx->stageTimes[GL_STAGE_SETUP];
+    stats.times.raster = ctx->stageTimes[GL_STAGE_RASTER];
+    stats.times.clear = ctx->stageTimes[GL_STAGE_CLEAR];
+}
+
+void vglContextResetStats(GLContext *ctx) {
+    ctx->commandQueue.finish();
+    std::copy(std::begin(ctx->counters), std::end(ctx->counters), ctx->countersBase);
+    std::fill(std::begin(ctx->stageTimes), std::end(ctx->stageTimes), 0);
+}
+
+void vglContextSetDeferred(GLContext *ctx, bool isEnabled) {
+    ctx->commandQueue.setEnabled(ctx, isEnabled);
+}
+
+uint64_t vglContextInsertFence(GLContext *ctx) {
+    return ctx->commandQueue.flush();
+}
+
+bool vglContextIsFenceSignaled(GLContext *ctx, uint64_t fence) {
+    return ctx->commandQueue.isSignaled(fence);
+}
+
+void vglContextWaitFence(GLContext *ctx, uint64_t fence) {
+    ctx->commandQueue.wait(fence);
+}
+
+void vglContextSetSwapChain(GLContext *ctx, int count) {
+    ctx->commandQueue.finish();
+    count = count < 2 ? 0 : count;
+    if (count == ctx->swapChain.getCount()) {
+        return;
+    }
+
+    const Vec2i size = ctx->bufferRect.getSize();
+    ctx->swapChain.setBuffers(count, size.x, size.y);
+    if (count) {
+        ctx->colorBufferData = std::vector<Color>();
+    }
+    else {
+        ctx->colorBufferData.resize(size.x*size.y);
+    }
+    updateFramebuffer(ctx);
+}
+
+static void swapBuffers(GLContext *ctx) {
+    if (!ctx->swapChain.getCount() || ctx->externalColorBuffer) {
+        return;
+    }
+    resolveColorBuffer(ctx);
+    ctx->swapChain.present();
+    updateFramebuffer(ctx);
+}
+
+static void executeSwapBuffers() {
+    swapBuffers(gCurrentContext);
+}
+
+void vglContextSwapBuffers(GLContext *ctx) {
+    if (ctx->commandQueue.isRecording()) {
+        ctx->commandQueue.recordCall<executeSwapBuffers>();
+        ctx->commandQueue.flush();
+        return;
+    }
+    swapBuffers(ctx);
+}
+
+bool vglContextAcquireFrame(GLContext *ctx, const void *&colorBuffer, int &pitch, uint64_t &frame) {
+    const Color *buffer;
+    int width;
+    if (!ctx->swapChain.acquireLatest(buffer, width, frame)) {
+        return false;
+    }
+    colorBuffer = buffer;
+    pitch = width*sizeof(Color);
+    return true;
+}
+
+void vglContextReleaseFrame(GLContext *ctx, uint64_t frame) {
+    ctx->swapChain.release(frame);
+}
+
+static_assert(static_cast<int>(VGL_SIMD_SSE2) == SIMD_SSE2 && static_cast<int>(VGL_SIMD_SSE41) == SIMD_SSE41 &&
+              static_cast<int>(VGL_SIMD_AVX2) == SIMD_AVX2, "SIMD levels must match");
+
+void vglSetSimdLevel(VGLSimdLevel level) {
+    gSimdLevel = static_cast<SimdLevel>(Math::min(static_cast<int>(level), static_cast<int>(getSupportedSimdLevel())));
+}
+
+VGLSimdLevel vglGetSimdLevel() {
+    return static_cast<VGLSimdLevel>(gSimdLevel.load());
 }
@@ -1,9 +1,109 @@
 #pragma once
+#include <stdint.h>
 
 struct GLContext;
 
-GLContext *vglContextCreate(int w, int h);
+// Depth buffer formats. The unorm formats map the depth range [-1, 1] to [0, 2^n - 1] and trade precision
+// for memory bandwidth, D24S8 keeps the depth in the low 24 bits and the stencil in the top 8 bits
+enum VGLDepthFormat {
+    VGL_DEPTH_D32F,
+    VGL_DEPTH_D24S8,
+    VGL_DEPTH_D16,
+};
+
+GLContext *vglContextCreate(int w, int h, VGLDepthFormat depthFormat = VGL_DEPTH_D32F);
 void vglContextDestroy(GLContext *ctx);
+// Binds the context to the calling thread, the GL calls of a thread draw into its current context. Contexts
+// share no state, so threads with different current contexts draw concurrently. A context must not be
+// current on two threads at once
 void vglContextMakeCurrent(GLContext *ctx);
 void vglContextResizeBuffers(GLContext *ctx, int w, int h);
+// Buffers are complete only after these calls, tiles which weren't drawn into since a fast clear are written here
 void vglContextGetColorBuffer(GLContext *ctx, void *&colorBuffer, int &pitch);
+void vglContextGetDepthBuffer(GLContext *ctx, const void *&depthBuffer, int &pitch);
+VGLDepthFormat vglContextGetDepthFormat(GLContext *ctx);
+// Draws into memory of the caller, e.g. a mapping shared with another process, instead of the context's own buffers.
+// Rows of colorBuffer are colorPitch bytes apart, a multiple of 4 and at least width*4, depthBuffer holds rows in the
+// depth format without padding. A null buffer switches back to the context's own one. The buffers must hold the
+// whole framebuffer until they are replaced, resizing switches back to the own buffers. glFlush and glFinish write
+// the pending fast clears and the resolved samples into them, the caller reads them after glFinish
+void vglContextSetExternalBuffers(GLContext *ctx, void *colorBuffer, int colorPitch, void *depthBuffer = nullptr);
+// Threads rasterizing the context's draws, including the calling one. Contexts drawing concurrently on their
+// own threads usually want 1 each
+void vglContextSetThreadCount(GLContext *ctx, int count);
+
+// 4 enables multisampling and 1 disables it, the other counts are ignored. Triangles cover the samples, which
+// get their own depth, and the color is computed once per pixel. Pixels inside triangles keep a single color
+// for their samples, so mostly the edges cost memory bandwidth. The color buffer gets the average of the
+// samples when it's read or swapped, the depth buffer holds the first sample
+void vglContextSetSampleCount(GLContext *ctx, int count);
+
+// With fast clears (the default) glClear only marks the tiles, they are written when drawn into or read back
+void vglContextSetFastClear(GLContext *ctx, bool isEnabled);
+
+// In the deferred mode the GL calls are recorded into a command buffer and return right away, and a worker thread of
+// the context executes them, so the next frame can be recorded while the previous one is rasterized. The commands
+// are submitted to the worker by glFlush, by fences and whenever enough of them are recorded. glFinish waits until
+// they are executed, the GL calls returning values and all the vglContext* functions reading or changing the
+// context wait as well. The context's GL calls and vglContext* functions must come from a single thread
+void vglContextSetDeferred(GLContext *ctx, bool isEnabled);
+
+// Submits the commands recorded so far and returns a fence signaled when they all are executed. Without
+// the deferred mode fences are signaled right away
+uint64_t vglContextInsertFence(GLContext *ctx);
+bool vglContextIsFenceSignaled(GLContext *ctx, uint64_t fence);
+void vglContextWaitFence(GLContext *ctx, uint64_t fence);
+
+// Replaces the context's color buffer with count buffers taking turns, count below 2 switches back to a single
+// one. Frames are drawn into the back buffer, which vglContextGetColorBuffer returns, and vglContextSwapBuffers
+// makes it the latest completed frame. Other threads read the completed frames while the next ones are drawn,
+// with 2 buffers swapping waits until a frame being read is released, with 3 it doesn't wait for a single reader.
+// Changing the count or resizing waits until all the frames are released. External color buffers bypass the swap
+// chain, and swapping does nothing while they are set
+void vglContextSetSwapChain(GLContext *ctx, int count);
+// In the deferred mode the swap is recorded and submitted, the frame completes when the worker gets to it
+void vglContextSwapBuffers(GLContext *ctx);
+// Can be called from any thread and doesn't wait. Returns false before the first frame completes, otherwise the
+// latest completed frame, which stays unchanged until it's released. Frames are numbered from 1, the readers
+// find the dropped ones from the gaps
+bool vglContextAcquireFrame(GLContext *ctx, const void *&colorBuffer, int &pitch, uint64_t &frame);
+void vglContextReleaseFrame(GLContext *ctx, uint64_t frame);
+
+// Time spent in the pipeline stages, in nanoseconds
+struct VGLStageTimes {
+    uint64_t vertex; // transform, clipping and projection
+    uint64_t setup; // triangle setup and binning
+    uint64_t raster;
+    uint64_t clear;
+};
+
+// Pipeline statistics since the context's creation or the last vglContextResetStats
+struct VGLStats {
+    uint64_t verticesSubmitted; // by glVertex, glDrawArrays and glDrawElements
+    uint64_t verticesTransformed; // glDrawElements transforms the vertices found in the post-transform cache only once
+    uint64_t vertexCacheHits;
+    uint64_t trianglesSubmitted;
+    uint64_t trianglesClipped; // crossing the near or the far plane or the guard band
+    uint64_t trianglesCulled; // outside the view volume, back-facing or covering no pixel centers, pieces made by clipping included
+    uint64_t trianglesRasterized;
+    // Pixels count once per triangle, also with multisampling, where a pixel is covered or passes with any of its samples
+    uint64_t pixelsTested; // covered pixels which reached the depth test, blocks rejected by the hierarchical depth are not counted
+    uint64_t pixelsPassed; // written pixels, overlapping triangles count every time they are drawn
+    uint64_t samplesPassed; // written samples as counted by GL_SAMPLES_PASSED, pixelsPassed without multisampling
+    double overdraw; // pixelsPassed per framebuffer pixel
+    VGLStageTimes times;
+};
+
+void vglContextGetStats(GLContext *ctx, VGLStats &stats);
+void vglContextResetStats(GLContext *ctx);
+
+// Instruction sets of the SIMD kernels. The best one the CPU supports is used by default
+enum VGLSimdLevel {
+    VGL_SIMD_SSE2,
+    VGL_SIMD_SSE41,
+    VGL_SIMD_AVX2,
+};
+
+// Selects the kernels of all contexts, levels the CPU doesn't support are lowered to the supported one
+void vglSetSimdLevel(VGLSimdLevel level);
+VGLSimdLevel vglGetSimdLevel();
\ No newline at end of file
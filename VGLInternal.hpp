@@ -1,13 +1,159 @@
 #pragma once
+#include "CommandQueue.hpp"
 #include "GLInternal.hpp"
 #include "Math.hpp"
+#include "Rasterizer.hpp"
+#include "RasterizerInternal.hpp"
+#include "SwapChain.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+#include "VertexProcessor.hpp"
+#include <map>
+#include <unordered_map>
 #include <vector>
+#include <chrono>
+
+// Pipeline stages with their own timers
+enum GLStage {
+    GL_STAGE_VERTEX, // transform, clipping and projection
+    GL_STAGE_SETUP, // triangle setup and binning
+    GL_STAGE_RASTER,
+    GL_STAGE_CLEAR,
+    GL_STAGES_COUNT,
+};
+
+// Pipeline counters, see VGLStats
+enum GLCounter {
+    GL_COUNTER_VERTICES_SUBMITTED,
+    GL_COUNTER_VERTICES_TRANSFORMED,
+    GL_COUNTER_VERTEX_CACHE_HITS,
+    GL_COUNTER_TRIANGLES_SUBMITTED,
+    GL_COUNTER_TRIANGLES_CLIPPED,
+    GL_COUNTER_TRIANGLES_CULLED,
+    GL_COUNTER_TRIANGLES_RASTERIZED,
+    GL_COUNTER_PIXELS_TESTED,
+    GL_COUNTER_PIXELS_PASSED,
+    GL_COUNTER_SAMPLES_PASSED,
+    GL_COUNTERS_COUNT,
+};
+
+// Targets which can have an active query at the same time
+enum GLQuerySlot {
+    GL_QUERY_SLOT_SAMPLES_PASSED,
+    GL_QUERY_SLOT_ANY_SAMPLES_PASSED,
+    GL_QUERY_SLOT_TIME_ELAPSED,
+    GL_QUERY_SLOTS_COUNT,
+};
+
+struct GLQuery {
+    bool isUsed = false; // generated and not deleted yet
+    uint32_t target = 0; // set by the first glBeginQuery or glQueryCounter
+    uint64_t start = 0; // counter or time at glBeginQuery
+    uint64_t result = 0;
+};
+
+struct GLTexture {
+    bool isUsed = false; // generated and not deleted yet
+    uint32_t minFilter = GL_NEAREST_MIPMAP_LINEAR;
+    uint32_t magFilter = GL_LINEAR;
+    uint32_t wrapS = GL_REPEAT;
+    uint32_t wrapT = GL_REPEAT;
+    bool isGenerateMipmap = false; // GL_GENERATE_MIPMAP, regenerates the levels when level 0 changes
+    TextureImage image;
+};
+
+// Vertex attributes set inside a display list, the others are taken from the current ones at glCallList
+constexpr uint8_t GL_LIST_COLOR_SET = 1 << 0;
+constexpr uint8_t GL_LIST_TEXCOORD_SET = 1 << 1;
+constexpr uint8_t GL_LIST_ATTRIBS_SET = GL_LIST_COLOR_SET | GL_LIST_TEXCOORD_SET;
+
+// Only the geometry of glBegin/glEnd is recorded, as triangles. The other commands are ignored with GL_COMPILE, see GL.hpp
+struct GLDisplayList {
+    std::vector<Vertex> vertices; // of all the glBegin/glEnd pairs, quads are already split
+    std::vector<uint8_t> vertexFlags; // GL_LIST_*_SET bits of every vertex
+    bool hasUnsetAttribs = false; // some vertices are completed by glCallList
+    uint64_t submittedCount = 0; // glVertex calls, for the statistics
+    // Current color and texture coordinates at glEndList, which glCallList leaves behind if the list set them
+    bool isColorSet = false;
+    bool isTexCoordSet = false;
+    Color color = Color(255, 255, 255, 255);
+    Vec2f texCoord = Vec2f(0.0f, 0.0f);
+};
 
 struct GLContext {
     IntRect bufferRect = IntRect(0, 0, 0, 0);
-    std::vector<Color> colorBufferData;
-    std::vector<float> depthBufferData;
+    std::vector<Color> colorBufferData; // empty with a swap chain
+    SwapChain swapChain;
+    RsDepthFormat depthFormat = RS_DEPTH_D32F;
+    std::vector<uint32_t> depthBufferData; // rows of values in depthFormat, without padding
+    std::vector<DepthRange> hiZBufferData;
+    // Memory of the caller replacing colorBufferData or depthBufferData, see vglContextSetExternalBuffers
+    Color *externalColorBuffer = nullptr;
+    int externalColorPitch = 0; // in pixels
+    void *externalDepthBuffer = nullptr;
+    // Multisampling draws into these, the color samples are resolved into the color buffer when it's read
+    int samplesCount = 1;
+    std::vector<Color> colorSampleData; // RS_SAMPLES_COUNT planes
+    std::vector<uint8_t> sampleFlagData;
+    std::vector<uint32_t> depthSampleData; // planes of the samples after the first one, which is in the depth buffer
+
+    // Fast clears only record the value, tiles are written when they are drawn into or when the buffers are read
+    bool isFastClear = true;
+    std::vector<uint8_t> tileClearFlags; // RS_CLEAR_* bits
+    Color fastClearColor = Color(0, 0, 0, 0);
+    uint32_t fastClearDepth = 0; // in depthFormat
+
     GLState state = GLState();
+    VpContext vertexProcessor;
+    RsContext rasterizer;
+    ThreadPool threadPool;
+
+    // Counters only grow, so active queries can read them. vglContextResetStats moves the base instead
+    uint64_t counters[GL_COUNTERS_COUNT] = {};
+    uint64_t countersBase[GL_COUNTERS_COUNT] = {};
+    uint64_t stageTimes[GL_STAGES_COUNT] = {}; // in nanoseconds
+
+    std::vector<GLQuery> queries; // query names are the indices + 1
+    std::vector<GLTexture> textures; // same for texture names
+    // Defined lists by name. glNewList takes any name, so they are not indexed by it
+    std::unordered_map<uint32_t, GLDisplayList> displayLists;
+    // Names generated or given to glNewList and not deleted yet, as disjoint spans of first name to count
+    std::map<uint32_t, uint32_t> reservedListNames;
+    uint32_t compiledListName = 0; // between glNewList and glEndList
+    uint32_t compileMode = 0;
+    GLDisplayList compiledList; // replaces the list's contents at glEndList
+    std::vector<uint8_t> compiledVertexFlags; // of the immediate mode vertices of the compiled list
+    std::vector<Vertex> calledListVertices; // vertices of glCallList completed with the current attributes
+    Color compileStartColor = Color(255, 255, 255, 255); // restored at glEndList in GL_COMPILE mode
+    Vec2f compileStartTexCoord = Vec2f(0.0f, 0.0f);
+    uint32_t activeQueries[GL_QUERY_SLOTS_COUNT] = {};
+
+    // Last, so the worker of the deferred mode stops before the rest is destroyed
+    CommandQueue commandQueue;
 };
 
-extern GLContext *gCurrentContext;
\ No newline at end of file
+// Context current on the calling thread, every thread can have its own
+extern thread_local GLContext *gCurrentContext;
+
+// Adds the time from its construction until stop() or its destruction to a stage timer of the current context
+class StageTimer {
+public:
+    explicit StageTimer(GLStage stage) : mStage(stage), mStart(std::chrono::steady_clock::now()) {}
+
+    ~StageTimer() {
+        stop();
+    }
+
+    void stop() {
+        if (mIsRunning) {
+            const auto elapsed = std::chrono::steady_clock::now() - mStart;
+            gCurrentContext->stageTimes[mStage] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            mIsRunning = false;
+        }
+    }
+
+private:
+    GLStage mStage;
+    std::chrono::steady_clock::time_point mStart;
+    bool mIsRunning = true;
+};
\ No newline at end of file
@@ -1,27 +1,445 @@
 #include "VertexProcessor.hpp"
 #include "GLInternal.hpp"
 #include "Rasterizer.hpp"
+#include "VGLInternal.hpp"
+#include <algorithm>
+#include "Platform.hpp"
 
-static std::vector<Vertex> gVertices;
+// Outcodes of the clip space positions. A vertex is inside the view volume when -w <= x, y, z <= w
+// and inside the guard band when -g*w <= x, y <= g*w
+constexpr uint16_t CLIP_LEFT = 1 << 0;
+constexpr uint16_t CLIP_RIGHT = 1 << 1;
+constexpr uint16_t CLIP_BOTTOM = 1 << 2;
+constexpr uint16_t CLIP_TOP = 1 << 3;
+constexpr uint16_t CLIP_NEAR = 1 << 4;
+constexpr uint16_t CLIP_FAR = 1 << 5;
+constexpr uint16_t CLIP_GUARD_LEFT = 1 << 6;
+constexpr uint16_t CLIP_GUARD_RIGHT = 1 << 7;
+constexpr uint16_t CLIP_GUARD_BOTTOM = 1 << 8;
+constexpr uint16_t CLIP_GUARD_TOP = 1 << 9;
+constexpr int CLIP_PLANES_COUNT = 10;
+constexpr uint16_t CLIP_VIEW_VOLUME = CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP | CLIP_NEAR | CLIP_FAR;
+// Triangles crossing only the view volume sides are left for the rasterizer's scissoring
+constexpr uint16_t CLIP_NEEDED = CLIP_NEAR | CLIP_FAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP;
+
+// Half extent of the guard band in pixels, vertices beyond it could overflow the fixed point triangle setup
+constexpr float VP_GUARD_BAND_SIZE = RS_MAX_COORD*0.5f;
 
 void vpAddVertex(Vertex &&v) {
-    gVertices.emplace_back(std::move(v));
+    VpContext &vp = gCurrentContext->vertexProcessor;
+    vp.vertices.emplace_back(std::move(v));
 }
 
-void vpProcess() {
-    auto vp = FloatRect(gCurrentState->viewport);
-    auto vpMat = Mat4f::createViewport(vp.min.x, vp.min.y, vp.getSize().x, vp.getSize().y);
-    auto mvp = gCurrentState->projMat*gCurrentState->modelViewMat;
-    for (auto &v : gVertices) {
-        v.pos = mvp*v.pos;
-        v.pos /= v.pos.w;
-        v.pos = vpMat*v.pos;
+// Packs the movemasks of the per plane comparisons into the outcodes of lanesCount vertices starting at i
+static void storeClipCodes(VpContext &vp, const int masks[CLIP_PLANES_COUNT], size_t i, int lanesCount) {
+    for (int lane = 0; lane < lanesCount; lane++) {
+        uint16_t code = 0;
+        for (int plane = 0; plane < CLIP_PLANES_COUNT; plane++) {
+            code |= ((masks[plane] >> lane) & 1) << plane;
+        }
+        vp.clipCodes[i + lane] = code;
+    }
+}
+
+// Transforms the first count positions of vp.positions from object space to clip space and computes their outcodes
+static void transformPositionsSSE2(VpContext &vp, const Mat4f &mvp, const Vec2f &guardBand, size_t count) {
+    __m128 m[4][4];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = _mm_set_ps1(mvp(r, c));
+        }
+    }
+    const __m128 guardX = _mm_set_ps1(guardBand.x);
+    const __m128 guardY = _mm_set_ps1(guardBand.y);
+    const __m128 signMask = _mm_set_ps1(-0.0f);
+
+    for (size_t i = 0; i < count; i += 4) {
+        const __m128 x = _mm_loadu_ps(&vp.positions.x[i]);
+        const __m128 y = _mm_loadu_ps(&vp.positions.y[i]);
+        const __m128 z = _mm_loadu_ps(&vp.positions.z[i]);
+        const __m128 w = _mm_loadu_ps(&vp.positions.w[i]);
+
+        __m128 clip[4];
+        for (int r = 0; r < 4; r++) {
+            clip[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r][0], x), _mm_mul_ps(m[r][1], y)), _mm_mul_ps(m[r][2], z)), _mm_mul_ps(m[r][3], w));
+        }
+        _mm_storeu_ps(&vp.positions.x[i], clip[0]);
+        _mm_storeu_ps(&vp.positions.y[i], clip[1]);
+        _mm_storeu_ps(&vp.positions.z[i], clip[2]);
+        _mm_storeu_ps(&vp.positions.w[i], clip[3]);
+
+        const __m128 negW = _mm_xor_ps(clip[3], signMask);
+        const __m128 guardW[2] = { _mm_mul_ps(clip[3], guardX), _mm_mul_ps(clip[3], guardY) };
+        const int masks[CLIP_PLANES_COUNT] = {
+            _mm_movemask_ps(_mm_cmplt_ps(clip[0], negW)),
+            _mm_movemask_ps(_mm_cmpgt_ps(clip[0], clip[3])),
+            _mm_movemask_ps(_mm_cmplt_ps(clip[1], negW)),
+            _mm_movemask_ps(_mm_cmpgt_ps(clip[1], clip[3])),
+            _mm_movemask_ps(_mm_cmplt_ps(clip[2], negW)),
+            _mm_movemask_ps(_mm_cmpgt_ps(clip[2], clip[3])),
+            _mm_movemask_ps(_mm_cmplt_ps(clip[0], _mm_xor_ps(guardW[0], signMask))),
+            _mm_movemask_ps(_mm_cmpgt_ps(clip[0], guardW[0])),
+            _mm_movemask_ps(_mm_cmplt_ps(clip[1], _mm_xor_ps(guardW[1], signMask))),
+            _mm_movemask_ps(_mm_cmpgt_ps(clip[1], guardW[1])),
+        };
+        storeClipCodes(vp, masks, i, 4);
+    }
+}
+
+// Same as transformPositionsSSE2 for 8 vertices at once, the results are bit exact with it
+static VGL_TARGET_AVX2 void transformPositionsAVX2(VpContext &vp, const Mat4f &mvp, const Vec2f &guardBand, size_t count) {
+    __m256 m[4][4];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = _mm256_set1_ps(mvp(r, c));
+        }
+    }
+    const __m256 guardX = _mm256_set1_ps(guardBand.x);
+    const __m256 guardY = _mm256_set1_ps(guardBand.y);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    for (size_t i = 0; i < count; i += 8) {
+        const __m256 x = _mm256_loadu_ps(&vp.positions.x[i]);
+        const __m256 y = _mm256_loadu_ps(&vp.positions.y[i]);
+        const __m256 z = _mm256_loadu_ps(&vp.positions.z[i]);
+        const __m256 w = _mm256_loadu_ps(&vp.positions.w[i]);
+
+        __m256 clip[4];
+        for (int r = 0; r < 4; r++) {
+            clip[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[r][0], x), _mm256_mul_ps(m[r][1], y)), _mm256_mul_ps(m[r][2], z)), _mm256_mul_ps(m[r][3], w));
+        }
+        _mm256_storeu_ps(&vp.positions.x[i], clip[0]);
+        _mm256_storeu_ps(&vp.positions.y[i], clip[1]);
+        _mm256_storeu_ps(&vp.positions.z[i], clip[2]);
+        _mm256_storeu_ps(&vp.positions.w[i], clip[3]);
+
+        const __m256 negW = _mm256_xor_ps(clip[3], signMask);
+        const __m256 guardW[2] = { _mm256_mul_ps(clip[3], guardX), _mm256_mul_ps(clip[3], guardY) };
+        const int masks[CLIP_PLANES_COUNT] = {
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[0], negW, _CMP_LT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[0], clip[3], _CMP_GT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[1], negW, _CMP_LT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[1], clip[3], _CMP_GT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[2], negW, _CMP_LT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[2], clip[3], _CMP_GT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[0], _mm256_xor_ps(guardW[0], signMask), _CMP_LT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[0], guardW[0], _CMP_GT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[1], _mm256_xor_ps(guardW[1], signMask), _CMP_LT_OQ)),
+            _mm256_movemask_ps(_mm256_cmp_ps(clip[1], guardW[1], _CMP_GT_OQ)),
+        };
+        storeClipCodes(vp, masks, i, 8);
+    }
+}
+
+static void transformPositions(VpContext &vp, const Mat4f &mvp, const Vec2f &guardBand, size_t count) {
+    vp.clipCodes.resize(vp.positions.x.size());
+    if (gSimdLevel >= SIMD_AVX2) {
+        transformPositionsAVX2(vp, mvp, guardBand, count);
+    }
+    else {
+        transformPositionsSSE2(vp, mvp, guardBand, count);
+    }
+}
+
+// Projects the first count positions of vp.positions from clip space to screen space. The viewport
+// transform is folded into the perspective divide as a scale and an offset, w is replaced with 1/w
+static void projectPositions(VpContext &vp, const Mat4f &vpMat, size_t count) {
+    const __m128 scaleX = _mm_set_ps1(vpMat(0, 0));
+    const __m128 scaleY = _mm_set_ps1(vpMat(1, 1));
+    const __m128 scaleZ = _mm_set_ps1(vpMat(2, 2));
+    const __m128 offsetX = _mm_set_ps1(vpMat(0, 3));
+    const __m128 offsetY = _mm_set_ps1(vpMat(1, 3));
+    const __m128 offsetZ = _mm_set_ps1(vpMat(2, 3));
+    const __m128 one = _mm_set_ps1(1.0f);
+
+    for (size_t i = 0; i < count; i += 4) {
+        const __m128 invW = _mm_div_ps(one, _mm_loadu_ps(&vp.positions.w[i]));
+        _mm_storeu_ps(&vp.positions.x[i], _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&vp.positions.x[i]), invW), scaleX), offsetX));
+        _mm_storeu_ps(&vp.positions.y[i], _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&vp.positions.y[i]), invW), scaleY), offsetY));
+        _mm_storeu_ps(&vp.positions.z[i], _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&vp.positions.z[i]), invW), scaleZ), offsetZ));
+        _mm_storeu_ps(&vp.positions.w[i], invW);
+    }
+}
+
+static Color lerpColor(const Color &a, const Color &b, float t) {
+    return Color(
+        static_cast<uint8_t>(a.r + (b.r - a.r)*t + 0.5f),
+        static_cast<uint8_t>(a.g + (b.g - a.g)*t + 0.5f),
+        static_cast<uint8_t>(a.b + (b.b - a.b)*t + 0.5f),
+        static_cast<uint8_t>(a.a + (b.a - a.a)*t + 0.5f));
+}
+
+// Signed distance of a clip space position to a clip plane, positive inside
+static float clipDistance(const Vec4f &pos, uint16_t plane, const Vec2f &guardBand) {
+    switch (plane) {
+        case CLIP_NEAR: return pos.w + pos.z;
+        case CLIP_FAR: return pos.w - pos.z;
+        case CLIP_GUARD_LEFT: return guardBand.x*pos.w + pos.x;
+        case CLIP_GUARD_RIGHT: return guardBand.x*pos.w - pos.x;
+        case CLIP_GUARD_BOTTOM: return guardBand.y*pos.w + pos.y;
+        default: return guardBand.y*pos.w - pos.y;
+    }
+}
+
+// Clips a triangle against the planes in codes (Sutherland-Hodgman) and appends the resulting triangle
+// fan to vp.clippedVertices. Vertices of the fan are referenced as firstRef + their index in vp.clippedVertices
+static void clipTriangle(VpContext &vp, const uint32_t refs[3], uint16_t codes, const Vec2f &guardBand, uint32_t firstRef) {
+    // Every plane adds at most one vertex to the polygon
+    constexpr int maxVerts = 3 + 6;
+    Vertex polys[2][maxVerts];
+    int vertsCount = 3;
+    for (int i = 0; i < 3; i++) {
+        polys[0][i].pos = vp.positions.get(refs[i]);
+        polys[0][i].color = vp.colors[refs[i]];
+        polys[0][i].texCoord = vp.texCoords[refs[i]];
+    }
+
+    int src = 0;
+    for (uint16_t plane = CLIP_NEAR; plane <= CLIP_GUARD_TOP && vertsCount >= 3; plane <<= 1) {
+        if (!(codes & plane)) {
+            continue;
+        }
+
+        const Vertex *in = polys[src];
+        Vertex *out = polys[src ^ 1];
+        int outCount = 0;
+        for (int i = 0; i < vertsCount; i++) {
+            const Vertex &a = in[i];
+            const Vertex &b = in[(i + 1) % vertsCount];
+            const float da = clipDistance(a.pos, plane, guardBand);
+            const float db = clipDistance(b.pos, plane, guardBand);
+            if (da >= 0.0f) {
+                out[outCount++] = a;
+            }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                const float t = da / (da - db);
+                out[outCount].pos = a.pos + (b.pos - a.pos)*t;
+                out[outCount].color = lerpColor(a.color, b.color, t);
+                out[outCount].texCoord = a.texCoord + (b.texCoord - a.texCoord)*t;
+                outCount++;
+            }
+        }
+        vertsCount = outCount;
+        src ^= 1;
+    }
+
+    if (vertsCount < 3) {
+        return;
+    }
+
+    const auto first = firstRef + static_cast<uint32_t>(vp.clippedVertices.size());
+    for (int i = 0; i < vertsCount; i++) {
+        vp.clippedVertices.push_back(polys[src][i]);
     }
+    for (int i = 1; i + 1 < vertsCount; i++) {
+        vp.triangleRefs.push_back(first);
+        vp.triangleRefs.push_back(first + i);
+        vp.triangleRefs.push_back(first + i + 1);
+    }
+}
+
+// Transforms the count vertices in vp.positions, vp.colors and vp.texCoords, clips the triangles listed by vp.outputRefs
+// and rasterizes them. Most triangles are either inside the guard band or outside one of the view
+// volume planes, only the remaining ones are actually clipped
+static void processVertexBatch(VpContext &vp, size_t count) {
+    StageTimer vertexTimer(GL_STAGE_VERTEX);
+    const auto viewport = FloatRect(gCurrentState->viewport);
+    const auto vpMat = Mat4f::createViewport(viewport.min.x, viewport.min.y, viewport.getSize().x, viewport.getSize().y);
+    const auto mvp = gCurrentState->projMat*gCurrentState->modelViewMat;
+    const Vec2f guardBand(
+        VP_GUARD_BAND_SIZE / Math::max(Math::abs(vpMat(0, 0)), 1.0f),
+        VP_GUARD_BAND_SIZE / Math::max(Math::abs(vpMat(1, 1)), 1.0f));
+
+    transformPositions(vp, mvp, guardBand, count);
+
+    vp.triangleRefs.clear();
+    vp.clippedVertices.clear();
+    const size_t refsCount = vp.outputRefs.size();
+    uint64_t rejectedCount = 0;
+    uint64_t clippedCount = 0;
+    for (size_t i = 0; i + 2 < refsCount; i += 3) {
+        const uint32_t *refs = &vp.outputRefs[i];
+        const uint16_t codeA = vp.clipCodes[refs[0]];
+        const uint16_t codeB = vp.clipCodes[refs[1]];
+        const uint16_t codeC = vp.clipCodes[refs[2]];
+        if (codeA & codeB & codeC & CLIP_VIEW_VOLUME) {
+            rejectedCount++;
+            continue;
+        }
 
+        const uint16_t codes = (codeA | codeB | codeC) & CLIP_NEEDED;
+        if (!codes) {
+            vp.triangleRefs.insert(vp.triangleRefs.end(), refs, refs + 3);
+        }
+        else {
+            clipTriangle(vp, refs, codes, guardBand, static_cast<uint32_t>(count));
+            clippedCount++;
+        }
+    }
+
+    uint64_t *counters = gCurrentContext->counters;
+    counters[GL_COUNTER_VERTICES_TRANSFORMED] += count;
+    counters[GL_COUNTER_TRIANGLES_SUBMITTED] += refsCount / 3;
+    counters[GL_COUNTER_TRIANGLES_CLIPPED] += clippedCount;
+    counters[GL_COUNTER_TRIANGLES_CULLED] += rejectedCount;
+
+    const size_t clippedVertsCount = vp.clippedVertices.size();
+    vp.positions.resize(count + clippedVertsCount);
+    vp.colors.resize(count + clippedVertsCount);
+    vp.texCoords.resize(count + clippedVertsCount);
+    for (size_t i = 0; i < clippedVertsCount; i++) {
+        vp.positions.set(count + i, vp.clippedVertices[i].pos);
+        vp.colors[count + i] = vp.clippedVertices[i].color;
+        vp.texCoords[count + i] = vp.clippedVertices[i].texCoord;
+    }
+
+    projectPositions(vp, vpMat, count + clippedVertsCount);
+
+    const size_t outCount = vp.triangleRefs.size();
+    vp.outputVertices.resize(outCount);
+    for (size_t i = 0; i < outCount; i++) {
+        Vertex &v = vp.outputVertices[i];
+        v.pos = vp.positions.get(vp.triangleRefs[i]);
+        v.color = vp.colors[vp.triangleRefs[i]];
+        v.texCoord = vp.texCoords[vp.triangleRefs[i]];
+    }
+
+    vertexTimer.stop();
+
+    const uint32_t primType = gCurrentState->primType;
+    gCurrentState->primType = GL_TRIANGLES;
+    vp.processedVertices = &vp.outputVertices;
     rsProcess();
-    gVertices.clear();
+    vp.processedVertices = nullptr;
+    gCurrentState->primType = primType;
+}
+
+void vpProcessVertices(const std::vector<Vertex> &vertices) {
+    VpContext &vp = gCurrentContext->vertexProcessor;
+    const size_t count = vertices.size();
+    vp.positions.resize(count);
+    vp.colors.resize(count);
+    vp.texCoords.resize(count);
+    vp.outputRefs.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        vp.positions.set(i, vertices[i].pos);
+        vp.colors[i] = vertices[i].color;
+        vp.texCoords[i] = vertices[i].texCoord;
+        vp.outputRefs[i] = static_cast<uint32_t>(i);
+    }
+
+    processVertexBatch(vp, count);
+}
+
+void vpProcess() {
+    VpContext &vp = gCurrentContext->vertexProcessor;
+    if (gCurrentState->primType == GL_TRIANGLES) {
+        vpProcessVertices(vp.vertices);
+    }
+    vp.vertices.clear();
+}
+
+void vpClear() {
+    gCurrentContext->vertexProcessor.vertices.clear();
+}
+
+static Vec4f fetchPosition(const GLArrayPointer &array, uint32_t idx) {
+    const float *data = reinterpret_cast<const float*>(array.getElement(idx));
+    return Vec4f(data[0], data[1], array.size > 2 ? data[2] : 0.0f, array.size > 3 ? data[3] : 1.0f);
+}
+
+static Color fetchColor(const GLArrayPointer &array, uint32_t idx) {
+    Color color;
+    if (array.type == GL_UNSIGNED_BYTE) {
+        const uint8_t *data = array.getElement(idx);
+        color = Color(data[0], data[1], data[2], array.size > 3 ? data[3] : 255);
+    }
+    else {
+        const float *data = reinterpret_cast<const float*>(array.getElement(idx));
+        color.setFloat4(data[0], data[1], data[2], array.size > 3 ? data[3] : 1.0f);
+    }
+    return color;
+}
+
+static Vec2f fetchTexCoord(const GLArrayPointer &array, uint32_t idx) {
+    const float *data = reinterpret_cast<const float*>(array.getElement(idx));
+    return Vec2f(data[0], array.size > 1 ? data[1] : 0.0f);
+}
+
+uint32_t vpFetchIndex(uint32_t indexType, const void *indices, uint32_t i) {
+    switch (indexType) {
+        case GL_UNSIGNED_BYTE: {
+            return static_cast<const uint8_t*>(indices)[i];
+        }
+        case GL_UNSIGNED_SHORT: {
+            return static_cast<const uint16_t*>(indices)[i];
+        }
+        default: {
+            return static_cast<const uint32_t*>(indices)[i];
+        }
+    }
+}
+
+void vpProcessArrays(const GLArrayPointer &vertexArray, const GLArrayPointer &colorArray, const GLArrayPointer &texCoordArray,
+                     uint32_t mode, int first, int count, uint32_t indexType, const void *indices) {
+    VpContext &vp = gCurrentContext->vertexProcessor;
+
+    // Quads are split into the triangles (0, 1, 2) and (0, 2, 3)
+    static const uint32_t quadCorners[] = { 0, 1, 2, 0, 2, 3 };
+    const bool isQuads = mode == GL_QUADS;
+    const uint32_t outCount = isQuads ? (count / 4)*6 : (count / 3)*3;
+
+    // First find out which array elements have to be transformed and which of them every output vertex uses
+    vp.sourceIndices.clear();
+    vp.outputRefs.resize(outCount);
+    if (indices) {
+        // Meshes reference the same vertex from several triangles, so the transformed vertices are kept
+        // in a small cache keyed by index. It lives for one draw call only, as the matrices may change
+        uint32_t cacheTags[VP_VERTEX_CACHE_SIZE];
+        uint32_t cacheRefs[VP_VERTEX_CACHE_SIZE];
+        std::fill(std::begin(cacheTags), std::end(cacheTags), UINT32_MAX);
+
+        for (uint32_t i = 0; i < outCount; i++) {
+            const uint32_t elementIdx = isQuads ? (i / 6)*4 + quadCorners[i % 6] : i;
+            const uint32_t idx = vpFetchIndex(indexType, indices, elementIdx);
+
+            const uint32_t slot = idx & (VP_VERTEX_CACHE_SIZE - 1);
+            if (cacheTags[slot] != idx) {
+                cacheTags[slot] = idx;
+                cacheRefs[slot] = static_cast<uint32_t>(vp.sourceIndices.size());
+                vp.sourceIndices.push_back(idx);
+            }
+            vp.outputRefs[i] = cacheRefs[slot];
+        }
+
+        gCurrentContext->counters[GL_COUNTER_VERTEX_CACHE_HITS] += outCount - vp.sourceIndices.size();
+    }
+    else {
+        const uint32_t vertsCount = isQuads ? (count / 4)*4 : outCount;
+        for (uint32_t i = 0; i < vertsCount; i++) {
+            vp.sourceIndices.push_back(first + i);
+        }
+        for (uint32_t i = 0; i < outCount; i++) {
+            vp.outputRefs[i] = isQuads ? (i / 6)*4 + quadCorners[i % 6] : i;
+        }
+    }
+
+    gCurrentContext->counters[GL_COUNTER_VERTICES_SUBMITTED] += isQuads ? (count / 4)*4 : outCount;
+
+    const size_t transformCount = vp.sourceIndices.size();
+    vp.positions.resize(transformCount);
+    vp.colors.resize(transformCount);
+    vp.texCoords.resize(transformCount);
+    for (size_t i = 0; i < transformCount; i++) {
+        vp.positions.set(i, fetchPosition(vertexArray, vp.sourceIndices[i]));
+        vp.colors[i] = colorArray.isEnabled ? fetchColor(colorArray, vp.sourceIndices[i]) : gCurrentState->imColor;
+        vp.texCoords[i] = texCoordArray.isEnabled ? fetchTexCoord(texCoordArray, vp.sourceIndices[i]) : gCurrentState->imTexCoord;
+    }
+
+    processVertexBatch(vp, transformCount);
 }
 
 const std::vector<Vertex> &vpGetVertices() {
-    return gVertices;
+    const VpContext &vp = gCurrentContext->vertexProcessor;
+    return vp.processedVertices ? *vp.processedVertices : vp.vertices;
 }
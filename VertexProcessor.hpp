@@ -2,12 +2,79 @@
 #include "Math.hpp"
 #include <vector>
 
-struct __declspec(align(16)) Vertex {
+struct GLArrayPointer;
+
+// Vertices transformed at once by the widest (AVX2) transform, the SIMD batches are padded to it
+constexpr uint32_t VP_BATCH_SIZE = 8;
+
+// Entries of the direct-mapped post-transform cache used for indexed drawing, must be a power of two
+constexpr uint32_t VP_VERTEX_CACHE_SIZE = 32;
+
+// After the transform pos holds screen space x, y, z and 1/w of the clip space position
+struct alignas(16) Vertex {
     Vec4f pos;
     Color color;
+    Vec2f texCoord;
+};
+
+// Positions of the vertices being transformed as a structure of arrays, so the transform
+// processes 4 or 8 vertices per instruction depending on the SIMD level
+struct PositionBatch {
+    std::vector<float> x, y, z, w;
+
+    void resize(size_t count) {
+        const size_t paddedCount = (count + VP_BATCH_SIZE - 1) & ~static_cast<size_t>(VP_BATCH_SIZE - 1);
+        this->x.resize(paddedCount, 0.0f);
+        this->y.resize(paddedCount, 0.0f);
+        this->z.resize(paddedCount, 0.0f);
+        this->w.resize(paddedCount, 1.0f);
+    }
+
+    void set(size_t i, const Vec4f &pos) {
+        this->x[i] = pos.x;
+        this->y[i] = pos.y;
+        this->z[i] = pos.z;
+        this->w[i] = pos.w;
+    }
+
+    Vec4f get(size_t i) const {
+        return Vec4f(this->x[i], this->y[i], this->z[i], this->w[i]);
+    }
+};
+
+// Vertices of a context and the scratch buffers of its draws. Every context has its own, so contexts
+// current on different threads transform their vertices without sharing anything
+struct VpContext {
+    std::vector<Vertex> vertices; // of the immediate mode
+    std::vector<Vertex> outputVertices;
+    // Vertices which the rasterizer reads while a draw is being processed, the immediate mode ones when null
+    const std::vector<Vertex> *processedVertices = nullptr;
+
+    PositionBatch positions;
+    std::vector<Color> colors;
+    std::vector<Vec2f> texCoords;
+    std::vector<uint16_t> clipCodes;
+    std::vector<uint32_t> sourceIndices; // array element of every transformed vertex
+    std::vector<uint32_t> outputRefs; // transformed vertex of every output vertex
+    std::vector<uint32_t> triangleRefs; // same after clipping
+    std::vector<Vertex> clippedVertices; // vertices created by clipping, in clip space
 };
 
 void vpAddVertex(Vertex &&v);
 void vpProcess();
+// Drops the immediate mode vertices without drawing them
+void vpClear();
+
+// Draws already triangulated vertices, such as the ones recorded in a display list
+void vpProcessVertices(const std::vector<Vertex> &vertices);
+
+// Transforms vertices straight from the client arrays. Without indices the vertices first..first + count - 1
+// are drawn, otherwise count indices of indexType are read. Disabled color and texture coordinate arrays are
+// replaced by the current color and texture coordinates
+void vpProcessArrays(const GLArrayPointer &vertexArray, const GLArrayPointer &colorArray, const GLArrayPointer &texCoordArray,
+                     uint32_t mode, int first, int count, uint32_t indexType, const void *indices);
+
+// Reads the index i of indices of indexType, GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+uint32_t vpFetchIndex(uint32_t indexType, const void *indices, uint32_t i);
 
 const std::vector<Vertex> &vpGetVertices();
\ No newline at end of file
@@ -0,0 +1,453 @@
+// Headless benchmark of the clear, transform and fill paths. Renders a fixed set of scenes into an offscreen
+// context and writes the throughput and the per stage times of each one as CSV or JSON
+#include "VGL.hpp"
+#include "GL.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+    int width = 1280;
+    int height = 720;
+    int frames = 20;
+    int threads = 0; // 0 - one per hardware thread
+    int simdLevel = -1; // -1 - the best supported one
+    VGLDepthFormat depthFormat = VGL_DEPTH_D32F;
+    int samples = 1;
+    bool isDeferred = false; // GL calls executed by the context's worker thread
+    bool isJson = false;
+    std::string filter;
+    std::string outPath;
+};
+
+enum SubmitMode {
+    SUBMIT_IMMEDIATE,
+    SUBMIT_ARRAYS,
+    SUBMIT_ELEMENTS,
+    SUBMIT_LIST, // immediate mode recorded into a display list once
+};
+
+// Indexed triangle list in normalized device coordinates
+struct Mesh {
+    std::vector<float> positions; // x, y, z
+    std::vector<uint8_t> colors; // r, g, b, a
+    std::vector<uint32_t> indices;
+
+    // Same triangles without the indices, for glDrawArrays
+    std::vector<float> flatPositions;
+    std::vector<uint8_t> flatColors;
+
+    mutable GLuint displayList = 0; // compiled by the first SUBMIT_LIST draw
+
+    uint32_t getTrianglesCount() const {
+        return static_cast<uint32_t>(indices.size() / 3);
+    }
+};
+
+struct Scene {
+    std::string name;
+    std::function<void()> setup;
+    std::function<void()> draw;
+    uint32_t trianglesPerFrame;
+};
+
+struct SceneResult {
+    std::string name;
+    int frames;
+    double msPerFrame;
+    double mtrisPerSec;
+    double mpixelsPerSec;
+    double clearMpixelsPerSec;
+    double overdraw;
+    VGLStageTimes stageTimes; // per frame
+};
+
+static uint32_t gRandomState = 1;
+
+// Deterministic across platforms, unlike rand()
+static float random01() {
+    gRandomState = gRandomState*1664525u + 1013904223u;
+    return static_cast<float>(gRandomState >> 8) / static_cast<float>(1 << 24);
+}
+
+static void addVertex(Mesh &mesh, float x, float y, float z) {
+    mesh.positions.insert(mesh.positions.end(), { x, y, z });
+    mesh.colors.insert(mesh.colors.end(), {
+        static_cast<uint8_t>(random01()*255.0f),
+        static_cast<uint8_t>(random01()*255.0f),
+        static_cast<uint8_t>(random01()*255.0f),
+        255 });
+}
+
+static void flattenMesh(Mesh &mesh) {
+    for (uint32_t idx : mesh.indices) {
+        mesh.flatPositions.insert(mesh.flatPositions.end(), &mesh.positions[idx*3], &mesh.positions[idx*3] + 3);
+        mesh.flatColors.insert(mesh.flatColors.end(), &mesh.colors[idx*4], &mesh.colors[idx*4] + 4);
+    }
+}
+
+// Layers of screen covering grids of cellSize x cellSize pixel quads, the nearest layer is drawn last
+static Mesh createGridMesh(const BenchOptions &options, int cellSize, int layersCount) {
+    Mesh mesh;
+    const int cellsX = (options.width + cellSize - 1) / cellSize;
+    const int cellsY = (options.height + cellSize - 1) / cellSize;
+    for (int layer = 0; layer < layersCount; layer++) {
+        const float z = 0.5f - static_cast<float>(layer) / layersCount;
+        const auto base = static_cast<uint32_t>(mesh.positions.size() / 3);
+        for (int y = 0; y <= cellsY; y++) {
+            for (int x = 0; x <= cellsX; x++) {
+                addVertex(mesh, 2.0f*x / cellsX - 1.0f, 2.0f*y / cellsY - 1.0f, z);
+            }
+        }
+        for (int y = 0; y < cellsY; y++) {
+            for (int x = 0; x < cellsX; x++) {
+                const uint32_t i = base + x + y*(cellsX + 1);
+                mesh.indices.insert(mesh.indices.end(), { i, i + 1, i + cellsX + 2, i, i + cellsX + 2, i + cellsX + 1 });
+            }
+        }
+    }
+    flattenMesh(mesh);
+    return mesh;
+}
+
+// Random triangles with an area of about trianglesSize^2 / 2 pixels
+static Mesh createRandomMesh(const BenchOptions &options, int trianglesCount, float trianglesSize) {
+    Mesh mesh;
+    const float sizeX = 2.0f*trianglesSize / options.width;
+    const float sizeY = 2.0f*trianglesSize / options.height;
+    for (int i = 0; i < trianglesCount; i++) {
+        const float x = random01()*2.0f - 1.0f;
+        const float y = random01()*2.0f - 1.0f;
+        const float z = random01()*2.0f - 1.0f;
+        const auto base = static_cast<uint32_t>(mesh.positions.size() / 3);
+        addVertex(mesh, x, y, z);
+        addVertex(mesh, x + sizeX, y, z);
+        addVertex(mesh, x, y + sizeY, z);
+        mesh.indices.insert(mesh.indices.end(), { base, base + 1, base + 2 });
+    }
+    flattenMesh(mesh);
+    return mesh;
+}
+
+static void drawMesh(const Mesh &mesh, SubmitMode mode) {
+    if (mode == SUBMIT_LIST) {
+        if (mesh.displayList == 0) {
+            mesh.displayList = glGenLists(1);
+            glNewList(mesh.displayList, GL_COMPILE);
+            drawMesh(mesh, SUBMIT_IMMEDIATE);
+            glEndList();
+        }
+        glCallList(mesh.displayList);
+        return;
+    }
+
+    if (mode == SUBMIT_IMMEDIATE) {
+        glBegin(GL_TRIANGLES);
+        for (uint32_t idx : mesh.indices) {
+            const uint8_t *color = &mesh.colors[idx*4];
+            const float *pos = &mesh.positions[idx*3];
+            glColor4f(color[0] / 255.0f, color[1] / 255.0f, color[2] / 255.0f, color[3] / 255.0f);
+            glVertex3f(pos[0], pos[1], pos[2]);
+        }
+        glEnd();
+        return;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    if (mode == SUBMIT_ARRAYS) {
+        glVertexPointer(3, GL_FLOAT, 0, mesh.flatPositions.data());
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, mesh.flatColors.data());
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(mesh.indices.size()));
+    }
+    else {
+        glVertexPointer(3, GL_FLOAT, 0, mesh.positions.data());
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, mesh.colors.data());
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, mesh.indices.data());
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+}
+
+static const struct {
+    const char *name;
+    GLenum func;
+} gDepthFuncs[] = {
+    { "never", GL_NEVER },
+    { "less", GL_LESS },
+    { "equal", GL_EQUAL },
+    { "lequal", GL_LEQUAL },
+    { "greater", GL_GREATER },
+    { "notequal", GL_NOTEQUAL },
+    { "gequal", GL_GEQUAL },
+    { "always", GL_ALWAYS },
+};
+
+static std::function<void()> makeDepthSetup(bool isDepthTest, GLenum func) {
+    return [=]() {
+        if (isDepthTest) {
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(func);
+        }
+        else {
+            glDisable(GL_DEPTH_TEST);
+        }
+        // Greater functions would reject everything against the far plane
+        glClearDepth((func == GL_GREATER || func == GL_GEQUAL) ? 0.0 : 1.0);
+    };
+}
+
+static std::vector<Scene> createScenes(const BenchOptions &options, std::vector<Mesh> &meshes) {
+    meshes.reserve(3);
+    meshes.push_back(createGridMesh(options, 8, 4));
+    meshes.push_back(createGridMesh(options, options.width, 8));
+    meshes.push_back(createRandomMesh(options, 20000, 6.0f));
+    const Mesh *smallGrid = &meshes[0];
+    const Mesh *hugeQuads = &meshes[1];
+    const Mesh *randomTris = &meshes[2];
+
+    std::vector<Scene> scenes;
+    scenes.push_back({ "clear", makeDepthSetup(false, GL_LESS), []() {}, 0 });
+
+    const struct {
+        const char *name;
+        SubmitMode mode;
+    } submitModes[] = {
+        { "immediate", SUBMIT_IMMEDIATE },
+        { "arrays", SUBMIT_ARRAYS },
+        { "elements", SUBMIT_ELEMENTS },
+        { "list", SUBMIT_LIST },
+    };
+    for (const auto &submit : submitModes) {
+        const SubmitMode mode = submit.mode;
+        scenes.push_back({ std::string("small_grid/") + submit.name, makeDepthSetup(true, GL_LESS),
+                           [=]() { drawMesh(*smallGrid, mode); }, smallGrid->getTrianglesCount() });
+        scenes.push_back({ std::string("random_tris/") + submit.name, makeDepthSetup(true, GL_LESS),
+                           [=]() { drawMesh(*randomTris, mode); }, randomTris->getTrianglesCount() });
+    }
+
+    const struct {
+        const char *name;
+        const Mesh *mesh;
+    } fillMeshes[] = {
+        { "small_grid", smallGrid },
+        { "huge_quads", hugeQuads },
+    };
+    for (const auto &fill : fillMeshes) {
+        const Mesh *mesh = fill.mesh;
+        scenes.push_back({ std::string(fill.name) + "/depth_off", makeDepthSetup(false, GL_LESS),
+                           [=]() { drawMesh(*mesh, SUBMIT_ELEMENTS); }, mesh->getTrianglesCount() });
+        for (const auto &depthFunc : gDepthFuncs) {
+            scenes.push_back({ std::string(fill.name) + "/depth_" + depthFunc.name, makeDepthSetup(true, depthFunc.func),
+                               [=]() { drawMesh(*mesh, SUBMIT_ELEMENTS); }, mesh->getTrianglesCount() });
+        }
+    }
+    return scenes;
+}
+
+static SceneResult runScene(GLContext *ctx, const BenchOptions &options, const Scene &scene) {
+    constexpr int warmupFrames = 2;
+
+    scene.setup();
+    for (int i = 0; i < warmupFrames; i++) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        scene.draw();
+    }
+
+    vglContextResetStats(ctx);
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.frames; i++) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        scene.draw();
+        glFlush();
+    }
+    glFinish();
+    const auto end = std::chrono::steady_clock::now();
+
+    VGLStats stats;
+    vglContextGetStats(ctx, stats);
+    const VGLStageTimes &times = stats.times;
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const double clearedPixels = static_cast<double>(options.width)*options.height*options.frames;
+
+    SceneResult result;
+    result.name = scene.name;
+    result.frames = options.frames;
+    result.msPerFrame = seconds*1000.0 / options.frames;
+    result.mtrisPerSec = static_cast<double>(scene.trianglesPerFrame)*options.frames / seconds*1e-6;
+    result.mpixelsPerSec = stats.pixelsPassed / seconds*1e-6;
+    result.clearMpixelsPerSec = times.clear ? clearedPixels / (times.clear*1e-9)*1e-6 : 0.0;
+    result.overdraw = stats.overdraw / options.frames;
+    result.stageTimes.vertex = times.vertex / options.frames;
+    result.stageTimes.setup = times.setup / options.frames;
+    result.stageTimes.raster = times.raster / options.frames;
+    result.stageTimes.clear = times.clear / options.frames;
+    return result;
+}
+
+static const char *getSimdLevelName(int level) {
+    static const char *names[] = { "sse2", "sse41", "avx2" };
+    return names[level];
+}
+
+static const char *getDepthFormatName(VGLDepthFormat format) {
+    static const char *names[] = { "d32f", "d24s8", "d16" };
+    return names[format];
+}
+
+static void writeCSV(FILE *file, const BenchOptions &options, const std::vector<SceneResult> &results) {
+    fprintf(file, "scene,width,height,threads,simd,depth,samples,frames,ms_per_frame,mtris_per_s,mpixels_per_s,clear_mpixels_per_s,overdraw,"
+                  "vertex_ns,setup_ns,raster_ns,clear_ns\n");
+    for (const auto &r : results) {
+        fprintf(file, "%s,%d,%d,%d,%s,%s,%d,%d,%.4f,%.3f,%.3f,%.3f,%.3f,%llu,%llu,%llu,%llu\n", r.name.c_str(), options.width, options.height,
+                options.threads, getSimdLevelName(vglGetSimdLevel()), getDepthFormatName(options.depthFormat), options.samples, r.frames, r.msPerFrame,
+                r.mtrisPerSec, r.mpixelsPerSec, r.clearMpixelsPerSec, r.overdraw, static_cast<unsigned long long>(r.stageTimes.vertex), static_cast<unsigned long long>(r.stageTimes.setup),
+                static_cast<unsigned long long>(r.stageTimes.raster), static_cast<unsigned long long>(r.stageTimes.clear));
+    }
+}
+
+static void writeJSON(FILE *file, const BenchOptions &options, const std::vector<SceneResult> &results) {
+    fprintf(file, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %d,\n  \"simd\": \"%s\",\n  \"depth\": \"%s\",\n  \"samples\": %d,\n  \"results\": [\n",
+            options.width, options.height, options.threads, getSimdLevelName(vglGetSimdLevel()), getDepthFormatName(options.depthFormat),
+            options.samples);
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+        fprintf(file, "    { \"scene\": \"%s\", \"frames\": %d, \"ms_per_frame\": %.4f, \"mtris_per_s\": %.3f, \"mpixels_per_s\": %.3f, "
+                      "\"clear_mpixels_per_s\": %.3f, \"overdraw\": %.3f, \"vertex_ns\": %llu, \"setup_ns\": %llu, \"raster_ns\": %llu, \"clear_ns\": %llu }%s\n",
+                r.name.c_str(), r.frames, r.msPerFrame, r.mtrisPerSec, r.mpixelsPerSec, r.clearMpixelsPerSec, r.overdraw,
+                static_cast<unsigned long long>(r.stageTimes.vertex), static_cast<unsigned long long>(r.stageTimes.setup),
+                static_cast<unsigned long long>(r.stageTimes.raster), static_cast<unsigned long long>(r.stageTimes.clear),
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+static void printUsage() {
+    printf("Usage: VGLBench [options]\n"
+           "  --width N, --height N   framebuffer size (1280x720)\n"
+           "  --frames N              measured frames per scene (20)\n"
+           "  --threads N             rasterizer threads, 0 - one per hardware thread (0)\n"
+           "  --simd sse2|sse41|avx2  highest kernel instruction set (best supported)\n"
+           "  --depth d32f|d24s8|d16  depth buffer format (d32f)\n"
+           "  --samples 1|4           samples per pixel, 4 - multisampling (1)\n"
+           "  --deferred              record the GL calls and execute them on a worker thread\n"
+           "  --filter TEXT           run only the scenes whose name contains TEXT\n"
+           "  --format csv|json       output format (csv)\n"
+           "  --out PATH              output file (stdout)\n"
+           "  --list                  print the scene names and exit\n");
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    bool isListOnly = false;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--width") && hasValue) {
+            options.width = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "--height") && hasValue) {
+            options.height = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "--frames") && hasValue) {
+            options.frames = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "--threads") && hasValue) {
+            options.threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "--simd") && hasValue) {
+            const std::string name = argv[++i];
+            options.simdLevel = (name == "sse2") ? VGL_SIMD_SSE2 : (name == "sse41") ? VGL_SIMD_SSE41 : VGL_SIMD_AVX2;
+        }
+        else if (!strcmp(arg, "--depth") && hasValue) {
+            const std::string name = argv[++i];
+            options.depthFormat = (name == "d16") ? VGL_DEPTH_D16 : (name == "d24s8") ? VGL_DEPTH_D24S8 : VGL_DEPTH_D32F;
+        }
+        else if (!strcmp(arg, "--samples") && hasValue) {
+            options.samples = atoi(argv[++i]);
+        }
+        else if (!strcmp(arg, "--deferred")) {
+            options.isDeferred = true;
+        }
+        else if (!strcmp(arg, "--filter") && hasValue) {
+            options.filter = argv[++i];
+        }
+        else if (!strcmp(arg, "--format") && hasValue) {
+            options.isJson = !strcmp(argv[++i], "json");
+        }
+        else if (!strcmp(arg, "--out") && hasValue) {
+            options.outPath = argv[++i];
+        }
+        else if (!strcmp(arg, "--list")) {
+            isListOnly = true;
+        }
+        else {
+            printUsage();
+            return strcmp(arg, "--help") ? 1 : 0;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || (options.samples != 1 && options.samples != 4)) {
+        printUsage();
+        return 1;
+    }
+
+    GLContext *ctx = vglContextCreate(options.width, options.height, options.depthFormat);
+    vglContextMakeCurrent(ctx);
+    if (options.threads > 0) {
+        vglContextSetThreadCount(ctx, options.threads);
+    }
+    if (options.simdLevel >= 0) {
+        vglSetSimdLevel(static_cast<VGLSimdLevel>(options.simdLevel));
+    }
+    vglContextSetSampleCount(ctx, options.samples);
+    vglContextSetDeferred(ctx, options.isDeferred);
+
+    glViewport(0, 0, options.width, options.height);
+    glClearColor(0.1f, 0.2f, 0.3f, 1.0f);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    std::vector<Mesh> meshes;
+    const std::vector<Scene> scenes = createScenes(options, meshes);
+
+    std::vector<SceneResult> results;
+    for (const Scene &scene : scenes) {
+        if (!options.filter.empty() && scene.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        if (isListOnly) {
+            printf("%s\n", scene.name.c_str());
+            continue;
+        }
+        results.push_back(runScene(ctx, options, scene));
+        fprintf(stderr, "%-28s %9.3f ms/frame\n", scene.name.c_str(), results.back().msPerFrame);
+    }
+
+    vglContextMakeCurrent(nullptr);
+    vglContextDestroy(ctx);
+    if (isListOnly) {
+        return 0;
+    }
+
+    FILE *file = options.outPath.empty() ? stdout : fopen(options.outPath.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "Can't open %s\n", options.outPath.c_str());
+        return 1;
+    }
+    if (options.isJson) {
+        writeJSON(file, options, results);
+    }
+    else {
+        writeCSV(file, options, results);
+    }
+    if (file != stdout) {
+        fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,1791 @@
+// Golden image conformance test. Renders scripted scenes through the public GL API and compares the color and
+// depth buffers with a straightforward scalar reference renderer, within per pixel tolerances.
+// Every scene is also rendered with all supported SIMD levels and several thread counts, which must give identical
+// buffers. The same goes for rendering without fast clears, deferred to a worker thread, into external buffers and
+// through a swap chain. Multisampled rendering is compared with a multisampled reference, and the unorm depth
+// formats with the D32F buffers. Finally several contexts draw the scenes concurrently on their own threads, which
+// must give the same buffers again.
+// Display list names, rejected draws, queries and pipeline statistics are checked against known results of
+// simple draws.
+// With --dump DIR the buffers are written as PPM (color) and PFM (depth) images, with a diff image per scene
+#include "VGL.hpp"
+#include "GL.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr int IMAGE_WIDTH = 131; // not multiples of the block and tile sizes on purpose
+constexpr int IMAGE_HEIGHT = 97;
+constexpr int COLOR_TOLERANCE = 2; // per channel
+constexpr float DEPTH_TOLERANCE = 1e-4f;
+constexpr double DEPTH_FORMAT_MISMATCH_RATIO = 0.005; // pixels whose depth test flips with the lower precision
+constexpr int CONCURRENT_CONTEXTS_COUNT = 4;
+// Padding at the end of the rows of the external color buffer, in pixels
+constexpr int EXTERNAL_PADDING = 7;
+constexpr uint32_t EXTERNAL_PADDING_VALUE = 0xDEADBEEF;
+// Samples of the multisampled contexts, in 1/256 pixel from the pixel center
+constexpr int MSAA_SAMPLES_COUNT = 4;
+constexpr int MSAA_SAMPLE_OFFSETS[MSAA_SAMPLES_COUNT][2] = { { -32, -96 }, { 96, -32 }, { -96, 32 }, { 32, 96 } };
+constexpr int MSAA_SAMPLE_MAX_OFFSET = 96;
+// Display list name picked by the application rather than by glGenLists
+constexpr GLuint LARGE_LIST_NAME = 0x7FFFFFFF;
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> color; // RGBA8
+    std::vector<float> depth;
+    uint64_t shadedPixelsCount = 0;
+};
+
+struct SceneVertex {
+    float pos[3];
+    float color[4];
+    float texCoord[2];
+};
+
+enum SubmitMode {
+    SUBMIT_IMMEDIATE,
+    SUBMIT_ARRAYS,
+    SUBMIT_ELEMENTS,
+    SUBMIT_LIST, // immediate mode compiled into a display list, then called
+    SUBMIT_LIST_EXECUTE, // same with GL_COMPILE_AND_EXECUTE
+    SUBMIT_LIST_LARGE_NAME, // same as SUBMIT_LIST with LARGE_LIST_NAME instead of a generated name
+    SUBMIT_LIST_CURRENT_COLOR, // same as SUBMIT_LIST without glColor in the list, called after a glColor of the first vertex
+};
+
+struct SceneDraw {
+    GLenum primType = GL_TRIANGLES; // GL_TRIANGLES or GL_QUADS
+    SubmitMode mode = SUBMIT_IMMEDIATE;
+    std::vector<SceneVertex> vertices;
+};
+
+struct Scene {
+    std::string name;
+    float projMat[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 }; // column major
+    float modelViewMat[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float clearDepth = 1.0f;
+    bool isDepthTest = false;
+    GLenum depthFunc = GL_LESS;
+    bool isDepthWrite = true;
+    bool colorMask[4] = { true, true, true, true };
+    bool isCullFace = false;
+    GLenum cullFace = GL_BACK;
+    GLenum frontFace = GL_CCW;
+    bool isBlend = false;
+    GLenum blendSrcFactor = GL_ONE;
+    GLenum blendDstFactor = GL_ZERO;
+    GLenum blendEquation = GL_FUNC_ADD;
+
+    // Texture modulating the vertex colors, the texels are RGBA8
+    bool isTexture = false;
+    int texWidth = 0;
+    int texHeight = 0;
+    std::vector<uint32_t> texels;
+    GLenum texMinFilter = GL_NEAREST;
+    GLenum texMagFilter = GL_NEAREST;
+    GLenum texWrap = GL_REPEAT;
+    bool isGenerateMipmap = false; // glGenerateMipmap after the upload
+    bool isAutoMipmap = false; // GL_GENERATE_MIPMAP before the upload
+
+    std::vector<SceneDraw> draws;
+    double maxMismatchRatio = 0.002; // pixels allowed to differ from the reference, for rounding at the edges
+};
+
+// ############################################################################################
+
+static uint32_t gRandomState = 1;
+
+static float random01() {
+    gRandomState = gRandomState*1664525u + 1013904223u;
+    return static_cast<float>(gRandomState >> 8) / static_cast<float>(1 << 24);
+}
+
+static float randomRange(float min, float max) {
+    return min + (max - min)*random01();
+}
+
+static SceneVertex makeVertex(float x, float y, float z) {
+    return SceneVertex{ { x, y, z }, { random01(), random01(), random01(), random01() } };
+}
+
+static SceneVertex makeTexturedVertex(float x, float y, float z, float s, float t) {
+    SceneVertex v = makeVertex(x, y, z);
+    v.texCoord[0] = s;
+    v.texCoord[1] = t;
+    return v;
+}
+
+// Random opaque texels with a lighter checkerboard on top, so both the filtering and the texel layout show up
+static void makeRandomTexture(Scene &scene, int width, int height) {
+    scene.isTexture = true;
+    scene.texWidth = width;
+    scene.texHeight = height;
+    scene.texels.resize(width*height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const uint32_t base = ((x ^ y) & 1) ? 0x80 : 0x00;
+            uint32_t texel = 0xFF000000;
+            for (int c = 0; c < 3; c++) {
+                texel |= (base + static_cast<uint32_t>(random01()*127.0f)) << (c*8);
+            }
+            scene.texels[x + y*width] = texel;
+        }
+    }
+}
+
+static SceneDraw makeRandomTriangles(int count, float minSize, float maxSize, float extent, SubmitMode mode) {
+    SceneDraw draw;
+    draw.mode = mode;
+    for (int i = 0; i < count; i++) {
+        const float x = randomRange(-extent, extent);
+        const float y = randomRange(-extent, extent);
+        for (int j = 0; j < 3; j++) {
+            draw.vertices.push_back(makeVertex(x + randomRange(minSize, maxSize)*(random01() < 0.5f ? -1.0f : 1.0f),
+                                               y + randomRange(minSize, maxSize)*(random01() < 0.5f ? -1.0f : 1.0f),
+                                               randomRange(-0.9f, 0.9f)));
+        }
+    }
+    return draw;
+}
+
+static void setPerspective(float m[16], float fovY, float aspect, float zNear, float zFar) {
+    const float f = 1.0f / tanf(fovY*0.5f);
+    std::fill(m, m + 16, 0.0f);
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zFar + zNear) / (zNear - zFar);
+    m[11] = -1.0f;
+    m[14] = 2.0f*zFar*zNear / (zNear - zFar);
+}
+
+static std::vector<Scene> createScenes() {
+    std::vector<Scene> scenes;
+
+    // Triangle fan with shared edges reaching past the viewport, every covered pixel must be drawn exactly once
+    {
+        Scene scene;
+        scene.name = "fill_rule_fan";
+        scene.maxMismatchRatio = 0.0;
+        SceneDraw draw;
+        const int segments = 29;
+        for (int i = 0; i < segments; i++) {
+            const float a0 = 6.2831853f*i / segments;
+            const float a1 = 6.2831853f*(i + 1) / segments;
+            draw.vertices.push_back(makeVertex(0.113f, -0.071f, 0.0f));
+            draw.vertices.push_back(makeVertex(1.7f*cosf(a0), 1.7f*sinf(a0), 0.0f));
+            draw.vertices.push_back(makeVertex(1.7f*cosf(a1), 1.7f*sinf(a1), 0.0f));
+        }
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    // Grid of quads with shared edges and corners on pixel centers, drawn as GL_QUADS
+    {
+        Scene scene;
+        scene.name = "fill_rule_quads";
+        scene.maxMismatchRatio = 0.0;
+        SceneDraw draw;
+        draw.primType = GL_QUADS;
+        const int cells = 9;
+        const int cellSize = 13;
+        auto toNdcX = [](int x) { return 2.0f*x / IMAGE_WIDTH - 1.0f; };
+        auto toNdcY = [](int y) { return 1.0f - 2.0f*y / IMAGE_HEIGHT; };
+        for (int y = 0; y < cells; y++) {
+            for (int x = 0; x < cells; x++) {
+                const float x0 = toNdcX(5 + x*cellSize);
+                const float x1 = toNdcX(5 + (x + 1)*cellSize);
+                const float y0 = toNdcY(3 + y*cellSize/2);
+                const float y1 = toNdcY(3 + (y + 1)*cellSize/2);
+                draw.vertices.push_back(makeVertex(x0, y0, 0.0f));
+                draw.vertices.push_back(makeVertex(x1, y0, 0.0f));
+                draw.vertices.push_back(makeVertex(x1, y1, 0.0f));
+                draw.vertices.push_back(makeVertex(x0, y1, 0.0f));
+            }
+        }
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    // Same triangles through every submission path
+    const struct {
+        const char *name;
+        SubmitMode mode;
+    } submitModes[] = {
+        { "submit_immediate", SUBMIT_IMMEDIATE },
+        { "submit_arrays", SUBMIT_ARRAYS },
+        { "submit_elements", SUBMIT_ELEMENTS },
+        { "submit_list", SUBMIT_LIST },
+        { "submit_list_execute", SUBMIT_LIST_EXECUTE },
+        { "submit_list_large_name", SUBMIT_LIST_LARGE_NAME },
+        { "submit_list_current_color", SUBMIT_LIST_CURRENT_COLOR },
+    };
+    for (const auto &submit : submitModes) {
+        gRandomState = 7;
+        Scene scene;
+        scene.name = submit.name;
+        scene.isDepthTest = true;
+        SceneDraw draw = makeRandomTriangles(150, 0.05f, 0.4f, 1.1f, submit.mode);
+        if (submit.mode == SUBMIT_LIST_CURRENT_COLOR) {
+            for (SceneVertex &v : draw.vertices) {
+                std::copy(draw.vertices[0].color, draw.vertices[0].color + 4, v.color);
+            }
+        }
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    const struct {
+        const char *name;
+        GLenum func;
+    } depthFuncs[] = {
+        { "never", GL_NEVER },
+        { "less", GL_LESS },
+        { "equal", GL_EQUAL },
+        { "lequal", GL_LEQUAL },
+        { "greater", GL_GREATER },
+        { "notequal", GL_NOTEQUAL },
+        { "gequal", GL_GEQUAL },
+        { "always", GL_ALWAYS },
+    };
+    for (const auto &depthFunc : depthFuncs) {
+        gRandomState = 11;
+        Scene scene;
+        scene.name = std::string("depth_") + depthFunc.name;
+        scene.isDepthTest = true;
+        scene.depthFunc = depthFunc.func;
+        scene.clearDepth = 0.25f;
+        scene.draws.push_back(makeRandomTriangles(200, 0.05f, 0.5f, 1.0f, SUBMIT_ELEMENTS));
+
+        // Coplanar layer drawn twice, so GL_EQUAL has something to pass
+        SceneDraw layer;
+        layer.mode = SUBMIT_ARRAYS;
+        const float quad[6][2] = { { -0.6f, -0.6f }, { 0.6f, -0.6f }, { 0.6f, 0.6f }, { -0.6f, -0.6f }, { 0.6f, 0.6f }, { -0.6f, 0.6f } };
+        for (int pass = 0; pass < 2; pass++) {
+            for (const auto &p : quad) {
+                layer.vertices.push_back(makeVertex(p[0], p[1], 0.0f));
+            }
+        }
+        scene.draws.push_back(layer);
+        scenes.push_back(scene);
+    }
+
+    {
+        gRandomState = 13;
+        Scene scene;
+        scene.name = "depth_write_off";
+        scene.isDepthTest = true;
+        scene.isDepthWrite = false;
+        scene.draws.push_back(makeRandomTriangles(150, 0.05f, 0.5f, 1.0f, SUBMIT_ELEMENTS));
+        scenes.push_back(scene);
+    }
+
+    {
+        gRandomState = 17;
+        Scene scene;
+        scene.name = "color_mask";
+        scene.isDepthTest = true;
+        scene.colorMask[1] = false;
+        scene.clearColor[1] = 0.5f;
+        scene.draws.push_back(makeRandomTriangles(150, 0.05f, 0.5f, 1.0f, SUBMIT_ELEMENTS));
+        scenes.push_back(scene);
+    }
+
+    const struct {
+        const char *name;
+        GLenum cullFace;
+        GLenum frontFace;
+    } cullModes[] = {
+        { "cull_back_ccw", GL_BACK, GL_CCW },
+        { "cull_front_ccw", GL_FRONT, GL_CCW },
+        { "cull_back_cw", GL_BACK, GL_CW },
+        { "cull_front_and_back", GL_FRONT_AND_BACK, GL_CCW },
+    };
+    for (const auto &cull : cullModes) {
+        gRandomState = 19;
+        Scene scene;
+        scene.name = cull.name;
+        scene.isCullFace = true;
+        scene.cullFace = cull.cullFace;
+        scene.frontFace = cull.frontFace;
+        scene.draws.push_back(makeRandomTriangles(150, 0.05f, 0.5f, 1.0f, SUBMIT_IMMEDIATE));
+        scenes.push_back(scene);
+    }
+
+    // Sub-pixel triangles, most of them cover no pixel center
+    {
+        gRandomState = 23;
+        Scene scene;
+        scene.name = "tiny_triangles";
+        scene.draws.push_back(makeRandomTriangles(2000, 0.001f, 0.02f, 1.0f, SUBMIT_ARRAYS));
+        scenes.push_back(scene);
+    }
+
+    // Triangles far outside the viewport, which need the guard band and scissoring
+    {
+        gRandomState = 29;
+        Scene scene;
+        scene.name = "viewport_edges";
+        scene.isDepthTest = true;
+        scene.draws.push_back(makeRandomTriangles(100, 0.5f, 40.0f, 3.0f, SUBMIT_ELEMENTS));
+        scenes.push_back(scene);
+    }
+
+    // Perspective ground plane through the near plane and past the far plane, plus geometry behind the camera
+    {
+        gRandomState = 31;
+        Scene scene;
+        scene.name = "perspective_clipping";
+        scene.isDepthTest = true;
+        setPerspective(scene.projMat, 1.0f, static_cast<float>(IMAGE_WIDTH) / IMAGE_HEIGHT, 0.1f, 50.0f);
+        SceneDraw draw;
+        draw.primType = GL_QUADS;
+        const float ground[4][3] = { { -80, -1, 5 }, { 80, -1, 5 }, { 80, -1, -80 }, { -80, -1, -80 } };
+        const float wall[4][3] = { { -2, -1, -4 }, { 2, -1, -3 }, { 2, 2, -3 }, { -2, 2, -4 } };
+        const float behind[4][3] = { { -1, -1, 3 }, { 1, -1, 3 }, { 1, 1, 3 }, { -1, 1, 3 } };
+        for (const auto *quad : { ground, wall, behind }) {
+            for (int i = 0; i < 4; i++) {
+                draw.vertices.push_back(makeVertex(quad[i][0], quad[i][1], quad[i][2]));
+            }
+        }
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    // Every blend equation and factor, some triangles are fully transparent
+    const struct {
+        const char *name;
+        GLenum srcFactor;
+        GLenum dstFactor;
+        GLenum equation;
+    } blendModes[] = {
+        { "blend_alpha", GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_FUNC_ADD },
+        { "blend_additive", GL_ONE, GL_ONE, GL_FUNC_ADD },
+        { "blend_premultiplied", GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_FUNC_ADD },
+        { "blend_multiply", GL_DST_COLOR, GL_ZERO, GL_FUNC_ADD },
+        { "blend_color_factors", GL_ONE_MINUS_DST_COLOR, GL_SRC_COLOR, GL_FUNC_ADD },
+        { "blend_dst_alpha", GL_DST_ALPHA, GL_ONE_MINUS_DST_ALPHA, GL_FUNC_ADD },
+        { "blend_alpha_saturate", GL_SRC_ALPHA_SATURATE, GL_ONE_MINUS_SRC_COLOR, GL_FUNC_ADD },
+        { "blend_subtract", GL_SRC_ALPHA, GL_ONE, GL_FUNC_SUBTRACT },
+        { "blend_reverse_subtract", GL_ONE, GL_ONE_MINUS_DST_ALPHA, GL_FUNC_REVERSE_SUBTRACT },
+        { "blend_min", GL_ONE, GL_ONE, GL_MIN },
+        { "blend_max", GL_ONE, GL_ONE, GL_MAX },
+    };
+    for (const auto &blend : blendModes) {
+        gRandomState = 37;
+        Scene scene;
+        scene.name = blend.name;
+        scene.isDepthTest = true;
+        scene.isDepthWrite = false;
+        scene.isBlend = true;
+        scene.blendSrcFactor = blend.srcFactor;
+        scene.blendDstFactor = blend.dstFactor;
+        scene.blendEquation = blend.equation;
+        scene.clearColor[0] = 0.2f;
+        scene.clearColor[1] = 0.4f;
+        scene.clearColor[2] = 0.6f;
+        scene.clearColor[3] = 0.5f;
+        SceneDraw draw = makeRandomTriangles(40, 0.1f, 0.6f, 1.0f, SUBMIT_ARRAYS);
+        for (size_t i = 0; i < draw.vertices.size(); i += 9) {
+            for (size_t j = i; j < i + 3; j++) {
+                draw.vertices[j].color[3] = 0.0f;
+            }
+        }
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    {
+        gRandomState = 41;
+        Scene scene;
+        scene.name = "blend_color_mask";
+        scene.isBlend = true;
+        scene.blendSrcFactor = GL_SRC_ALPHA;
+        scene.blendDstFactor = GL_ONE_MINUS_SRC_ALPHA;
+        scene.colorMask[0] = false;
+        scene.colorMask[3] = false;
+        scene.clearColor[0] = 0.5f;
+        scene.draws.push_back(makeRandomTriangles(40, 0.1f, 0.6f, 1.0f, SUBMIT_ELEMENTS));
+        scenes.push_back(scene);
+    }
+
+    // Perspective textured ground plane with repeated texture coordinates, through both filters and submission paths
+    const struct {
+        const char *name;
+        GLenum filter;
+        SubmitMode mode;
+    } texturedPlanes[] = {
+        { "texture_nearest", GL_NEAREST, SUBMIT_IMMEDIATE },
+        { "texture_linear", GL_LINEAR, SUBMIT_ELEMENTS },
+    };
+    for (const auto &plane : texturedPlanes) {
+        gRandomState = 43;
+        Scene scene;
+        scene.name = plane.name;
+        scene.isDepthTest = true;
+        scene.maxMismatchRatio = 0.01; // texel boundaries rounded the other way
+        setPerspective(scene.projMat, 1.0f, static_cast<float>(IMAGE_WIDTH) / IMAGE_HEIGHT, 0.1f, 50.0f);
+        makeRandomTexture(scene, 16, 16);
+        scene.texMinFilter = plane.filter;
+        scene.texMagFilter = plane.filter;
+        SceneDraw draw;
+        draw.primType = GL_QUADS;
+        draw.mode = plane.mode;
+        draw.vertices.push_back(makeTexturedVertex(-6, -1, 2, -3.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(6, -1, 2, 3.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(6, -1, -30, 3.0f, 8.0f));
+        draw.vertices.push_back(makeTexturedVertex(-6, -1, -30, -3.0f, 8.0f));
+        draw.vertices.push_back(makeTexturedVertex(-1, -1, -4, 0.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(1, -1, -3, 1.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(1, 1, -3, 1.0f, 1.0f));
+        draw.vertices.push_back(makeTexturedVertex(-1, 1, -4, 0.0f, 1.0f));
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    // Magnified texture whose size is not a multiple of the texel tiles, sampled outside [0, 1] with clamping
+    {
+        gRandomState = 47;
+        Scene scene;
+        scene.name = "texture_clamp_npot";
+        scene.maxMismatchRatio = 0.01;
+        makeRandomTexture(scene, 13, 7);
+        scene.texMinFilter = GL_LINEAR;
+        scene.texMagFilter = GL_LINEAR;
+        scene.texWrap = GL_CLAMP_TO_EDGE;
+        SceneDraw draw;
+        draw.mode = SUBMIT_ARRAYS;
+        const float quad[6][2] = { { -0.9f, -0.9f }, { 0.9f, -0.9f }, { 0.9f, 0.9f }, { -0.9f, -0.9f }, { 0.9f, 0.9f }, { -0.9f, 0.9f } };
+        for (const auto &p : quad) {
+            draw.vertices.push_back(makeTexturedVertex(p[0], p[1], 0.0f, p[0]*0.9f + 0.5f, p[1]*0.9f + 0.5f));
+        }
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    // Minified ground plane and a magnified wall, with every way to pick the mip levels. The texture sizes other than
+    // powers of two have levels which drop a row or column, or are averaged with their copy when 1 texel wide
+    const struct {
+        const char *name;
+        GLenum minFilter;
+        GLenum magFilter;
+        int width, height;
+        bool isAutoMipmap;
+        double maxMismatchRatio; // level and texel boundaries rounded the other way
+    } mipmapModes[] = {
+        { "mipmap_nearest_nearest", GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST, 32, 32, false, 0.02 },
+        { "mipmap_linear_nearest", GL_LINEAR_MIPMAP_NEAREST, GL_LINEAR, 64, 16, false, 0.02 },
+        { "mipmap_nearest_linear", GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR, 32, 32, true, 0.02 },
+        { "mipmap_linear_linear", GL_LINEAR_MIPMAP_LINEAR, GL_NEAREST, 40, 24, true, 0.02 },
+        { "mipmap_minify_linear", GL_LINEAR, GL_NEAREST, 32, 32, false, 0.05 }, // no levels, aliased at the horizon
+    };
+    for (const auto &mipmap : mipmapModes) {
+        gRandomState = 53;
+        Scene scene;
+        scene.name = mipmap.name;
+        scene.isDepthTest = true;
+        scene.maxMismatchRatio = mipmap.maxMismatchRatio;
+        setPerspective(scene.projMat, 1.0f, static_cast<float>(IMAGE_WIDTH) / IMAGE_HEIGHT, 0.1f, 50.0f);
+        makeRandomTexture(scene, mipmap.width, mipmap.height);
+        scene.texMinFilter = mipmap.minFilter;
+        scene.texMagFilter = mipmap.magFilter;
+        scene.isAutoMipmap = mipmap.isAutoMipmap;
+        scene.isGenerateMipmap = !mipmap.isAutoMipmap;
+        SceneDraw draw;
+        draw.primType = GL_QUADS;
+        draw.mode = SUBMIT_ARRAYS;
+        draw.vertices.push_back(makeTexturedVertex(-20, -1, 2, -10.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(20, -1, 2, 10.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(20, -1, -45, 10.0f, 24.0f));
+        draw.vertices.push_back(makeTexturedVertex(-20, -1, -45, -10.0f, 24.0f));
+        draw.vertices.push_back(makeTexturedVertex(-1, 0, -3, 0.0f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(1, 0, -2, 0.5f, 0.0f));
+        draw.vertices.push_back(makeTexturedVertex(1, 1.5f, -2, 0.5f, 0.5f));
+        draw.vertices.push_back(makeTexturedVertex(-1, 1.5f, -3, 0.0f, 0.5f));
+        scene.draws.push_back(draw);
+        scenes.push_back(scene);
+    }
+
+    return scenes;
+}
+
+// ############################################################################################
+
+static void drawScene(const Scene &scene) {
+    glClearColor(scene.clearColor[0], scene.clearColor[1], scene.clearColor[2], scene.clearColor[3]);
+    glClearDepth(scene.clearDepth);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(scene.projMat);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(scene.modelViewMat);
+
+    if (scene.isDepthTest) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    else {
+        glDisable(GL_DEPTH_TEST);
+    }
+    glDepthFunc(scene.depthFunc);
+    glDepthMask(scene.isDepthWrite ? GL_TRUE : GL_FALSE);
+    glColorMask(scene.colorMask[0], scene.colorMask[1], scene.colorMask[2], scene.colorMask[3]);
+    if (scene.isCullFace) {
+        glEnable(GL_CULL_FACE);
+    }
+    else {
+        glDisable(GL_CULL_FACE);
+    }
+    glCullFace(scene.cullFace);
+    glFrontFace(scene.frontFace);
+    if (scene.isBlend) {
+        glEnable(GL_BLEND);
+    }
+    else {
+        glDisable(GL_BLEND);
+    }
+    glBlendFunc(scene.blendSrcFactor, scene.blendDstFactor);
+    glBlendEquation(scene.blendEquation);
+
+    GLuint texture = 0;
+    if (scene.isTexture) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, scene.isAutoMipmap ? GL_TRUE : GL_FALSE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, scene.texWidth, scene.texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, scene.texels.data());
+        if (scene.isGenerateMipmap) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, scene.texMinFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, scene.texMagFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, scene.texWrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, scene.texWrap);
+        glEnable(GL_TEXTURE_2D);
+    }
+
+    for (const SceneDraw &draw : scene.draws) {
+        const auto count = static_cast<GLsizei>(draw.vertices.size());
+        if (draw.mode != SUBMIT_ARRAYS && draw.mode != SUBMIT_ELEMENTS) {
+            const bool isList = draw.mode != SUBMIT_IMMEDIATE;
+            const bool isCompileOnly = draw.mode != SUBMIT_LIST_EXECUTE;
+            const bool isCurrentColor = draw.mode == SUBMIT_LIST_CURRENT_COLOR;
+            const GLuint list = !isList ? 0 : (draw.mode == SUBMIT_LIST_LARGE_NAME) ? LARGE_LIST_NAME : glGenLists(1);
+            if (isList) {
+                if (isCurrentColor) {
+                    glColor4f(1.0f, 0.0f, 1.0f, 1.0f); // current at compile time only, the list must not keep it
+                }
+                glNewList(list, isCompileOnly ? GL_COMPILE : GL_COMPILE_AND_EXECUTE);
+                if (isCompileOnly) {
+                    // Not recorded, so ignored
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    glTranslatef(0.5f, 0.0f, 0.0f);
+                    glDisable(GL_DEPTH_TEST);
+                }
+            }
+
+            // Split in several glBegin/glEnd pairs, which a display list merges
+            const size_t vertsPerBegin = (draw.primType == GL_QUADS) ? 40 : 30;
+            for (size_t first = 0; first < draw.vertices.size(); first += vertsPerBegin) {
+                glBegin(draw.primType);
+                for (size_t i = first; i < std::min(first + vertsPerBegin, draw.vertices.size()); i++) {
+                    const SceneVertex &v = draw.vertices[i];
+                    if (!isCurrentColor) {
+                        glColor4f(v.color[0], v.color[1], v.color[2], v.color[3]);
+                    }
+                    glTexCoord2f(v.texCoord[0], v.texCoord[1]);
+                    glVertex3f(v.pos[0], v.pos[1], v.pos[2]);
+                }
+                glEnd();
+            }
+
+            if (isList) {
+                glEndList();
+                if (isCurrentColor) {
+                    const float *color = draw.vertices[0].color;
+                    glColor4f(color[0], color[1], color[2], color[3]);
+                }
+                if (isCompileOnly) {
+                    glCallList(list);
+                }
+                glDeleteLists(list, 1);
+            }
+            continue;
+        }
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(SceneVertex), draw.vertices[0].pos);
+        glColorPointer(4, GL_FLOAT, sizeof(SceneVertex), draw.vertices[0].color);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(SceneVertex), draw.vertices[0].texCoord);
+        if (scene.isTexture) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        }
+        if (draw.mode == SUBMIT_ARRAYS) {
+            glDrawArrays(draw.primType, 0, count);
+        }
+        else {
+            std::vector<GLushort> indices(count);
+            for (GLsizei i = 0; i < count; i++) {
+                indices[i] = static_cast<GLushort>(i);
+            }
+            glDrawElements(draw.primType, count, GL_UNSIGNED_SHORT, indices.data());
+        }
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+
+    if (scene.isTexture) {
+        glDisable(GL_TEXTURE_2D);
+        glDeleteTextures(1, &texture);
+    }
+}
+
+static float decodeDepth(VGLDepthFormat format, const uint8_t *src) {
+    uint32_t bits = 0;
+    if (format == VGL_DEPTH_D32F) {
+        float depth;
+        memcpy(&depth, src, sizeof(depth));
+        return depth;
+    }
+    else if (format == VGL_DEPTH_D24S8) {
+        memcpy(&bits, src, sizeof(bits));
+        return static_cast<float>(bits & 0xFFFFFF) / 0xFFFFFF*2.0f - 1.0f;
+    }
+    memcpy(&bits, src, sizeof(uint16_t));
+    return static_cast<float>(bits) / 0xFFFF*2.0f - 1.0f;
+}
+
+static Image renderScene(GLContext *ctx, const Scene &scene) {
+    vglContextResetStats(ctx);
+    drawScene(scene);
+
+    Image image;
+    image.width = IMAGE_WIDTH;
+    image.height = IMAGE_HEIGHT;
+    image.color.resize(IMAGE_WIDTH*IMAGE_HEIGHT);
+    image.depth.resize(IMAGE_WIDTH*IMAGE_HEIGHT);
+
+    void *colorBuffer;
+    const void *depthBuffer;
+    int colorPitch, depthPitch;
+    vglContextGetColorBuffer(ctx, colorBuffer, colorPitch);
+    vglContextGetDepthBuffer(ctx, depthBuffer, depthPitch);
+    const VGLDepthFormat depthFormat = vglContextGetDepthFormat(ctx);
+    const int depthSize = depthFormat == VGL_DEPTH_D16 ? 2 : 4;
+    for (int y = 0; y < IMAGE_HEIGHT; y++) {
+        memcpy(&image.color[y*IMAGE_WIDTH], static_cast<const uint8_t*>(colorBuffer) + y*colorPitch, IMAGE_WIDTH*sizeof(uint32_t));
+        const uint8_t *depthRow = static_cast<const uint8_t*>(depthBuffer) + y*depthPitch;
+        for (int x = 0; x < IMAGE_WIDTH; x++) {
+            image.depth[x + y*IMAGE_WIDTH] = decodeDepth(depthFormat, depthRow + x*depthSize);
+        }
+    }
+    VGLStats stats;
+    vglContextGetStats(ctx, stats);
+    image.shadedPixelsCount = stats.pixelsPassed;
+    return image;
+}
+
+// ############################################################################################
+// Reference renderer. Follows the same conventions as the library (pixel centers at integer coordinates,
+// 8 bits of sub-pixel precision, top-left fill rule, window y pointing down, screen space linear
+// interpolation, perspective correct for texture coordinates, levels of detail per 2x2 pixel quad) with none of its optimizations, in double precision
+
+struct RefVertex {
+    double pos[4]; // clip space, then screen space with the clip space w
+    double color[4]; // 0..255
+    double texCoord[2];
+};
+
+static uint8_t toColorByte(float c) {
+    return static_cast<uint8_t>(c*255);
+}
+
+static bool refDepthTest(GLenum func, float z, float oldZ) {
+    switch (func) {
+        case GL_NEVER: return false;
+        case GL_LESS: return z < oldZ;
+        case GL_EQUAL: return fabsf(z - oldZ) < FLT_EPSILON;
+        case GL_LEQUAL: return z <= oldZ;
+        case GL_GREATER: return z > oldZ;
+        case GL_NOTEQUAL: return fabsf(z - oldZ) > FLT_EPSILON;
+        case GL_GEQUAL: return z >= oldZ;
+        default: return true;
+    }
+}
+
+// Factor for the channel c, the colors are in [0, 1]
+static double refBlendFactor(GLenum factor, const double src[4], const double dst[4], int c) {
+    switch (factor) {
+        case GL_ZERO: return 0.0;
+        case GL_SRC_COLOR: return src[c];
+        case GL_ONE_MINUS_SRC_COLOR: return 1.0 - src[c];
+        case GL_SRC_ALPHA: return src[3];
+        case GL_ONE_MINUS_SRC_ALPHA: return 1.0 - src[3];
+        case GL_DST_ALPHA: return dst[3];
+        case GL_ONE_MINUS_DST_ALPHA: return 1.0 - dst[3];
+        case GL_DST_COLOR: return dst[c];
+        case GL_ONE_MINUS_DST_COLOR: return 1.0 - dst[c];
+        case GL_SRC_ALPHA_SATURATE: return c == 3 ? 1.0 : std::min(src[3], 1.0 - dst[3]);
+        default: return 1.0;
+    }
+}
+
+// The source is quantized to 8 bits before blending, as it would be written without blending
+static void refBlend(const Scene &scene, const uint8_t srcBytes[4], uint8_t dstBytes[4], uint8_t result[4]) {
+    double src[4], dst[4];
+    for (int c = 0; c < 4; c++) {
+        src[c] = srcBytes[c] / 255.0;
+        dst[c] = dstBytes[c] / 255.0;
+    }
+    for (int c = 0; c < 4; c++) {
+        const double s = src[c]*refBlendFactor(scene.blendSrcFactor, src, dst, c);
+        const double d = dst[c]*refBlendFactor(scene.blendDstFactor, src, dst, c);
+        double value;
+        switch (scene.blendEquation) {
+            case GL_FUNC_SUBTRACT: value = s - d; break;
+            case GL_FUNC_REVERSE_SUBTRACT: value = d - s; break;
+            case GL_MIN: value = std::min(src[c], dst[c]); break;
+            case GL_MAX: value = std::max(src[c], dst[c]); break;
+            default: value = s + d; break;
+        }
+        result[c] = static_cast<uint8_t>(floor(std::min(std::max(value, 0.0), 1.0)*255.0 + 0.5));
+    }
+}
+
+struct RefTextureLevel {
+    int width, height;
+    std::vector<uint32_t> texels;
+};
+
+// Level 0 and, with mipmapping, the 2x2 box filtered levels down to 1x1. Odd sizes drop the last row or column
+static std::vector<RefTextureLevel> refMakeTextureLevels(const Scene &scene) {
+    std::vector<RefTextureLevel> levels = { { scene.texWidth, scene.texHeight, scene.texels } };
+    const bool isMipmap = scene.texMinFilter != GL_NEAREST && scene.texMinFilter != GL_LINEAR;
+    while (isMipmap && (levels.back().width > 1 || levels.back().height > 1)) {
+        const RefTextureLevel &src = levels.back();
+        RefTextureLevel dst = { std::max(src.width / 2, 1), std::max(src.height / 2, 1), {} };
+        for (int y = 0; y < dst.height; y++) {
+            for (int x = 0; x < dst.width; x++) {
+                uint32_t texel = 0;
+                for (int c = 0; c < 4; c++) {
+                    uint32_t sum = 2;
+                    for (int i = 0; i < 4; i++) {
+                        const int sx = std::min(x*2 + (i & 1), src.width - 1);
+                        const int sy = std::min(y*2 + (i >> 1), src.height - 1);
+                        sum += (src.texels[sx + sy*src.width] >> (c*8)) & 0xFF;
+                    }
+                    texel |= (sum / 4) << (c*8);
+                }
+                dst.texels.push_back(texel);
+            }
+        }
+        levels.push_back(dst);
+    }
+    return levels;
+}
+
+static int refWrapTexel(GLenum wrap, int i, int size) {
+    if (wrap == GL_REPEAT) {
+        return ((i % size) + size) % size;
+    }
+    return std::min(std::max(i, 0), size - 1);
+}
+
+static void refFetchTexel(const Scene &scene, const RefTextureLevel &level, int x, int y, double texel[4]) {
+    const uint32_t rgba = level.texels[refWrapTexel(scene.texWrap, x, level.width) + refWrapTexel(scene.texWrap, y, level.height)*level.width];
+    for (int c = 0; c < 4; c++) {
+        texel[c] = static_cast<double>((rgba >> (c*8)) & 0xFF);
+    }
+}
+
+// Texel color in [0, 255] of one level at the texture coordinates (s, t)
+static void refSampleLevel(const Scene &scene, const RefTextureLevel &level, GLenum filter, double s, double t, double texel[4]) {
+    const double x = s*level.width;
+    const double y = t*level.height;
+    if (filter == GL_NEAREST) {
+        refFetchTexel(scene, level, static_cast<int>(floor(x)), static_cast<int>(floor(y)), texel);
+        return;
+    }
+    const double x0 = floor(x - 0.5);
+    const double y0 = floor(y - 0.5);
+    const double fx = x - 0.5 - x0;
+    const double fy = y - 0.5 - y0;
+    double corners[4][4];
+    for (int i = 0; i < 4; i++) {
+        refFetchTexel(scene, level, static_cast<int>(x0) + (i & 1), static_cast<int>(y0) + (i >> 1), corners[i]);
+    }
+    for (int c = 0; c < 4; c++) {
+        const double top = corners[0][c] + (corners[1][c] - corners[0][c])*fx;
+        const double bottom = corners[2][c] + (corners[3][c] - corners[2][c])*fx;
+        texel[c] = top + (bottom - top)*fy;
+    }
+}
+
+// Texel color at the texture coordinates (s, t) with the level of detail lod
+static void refSampleTexture(const Scene &scene, const std::vector<RefTextureLevel> &levels, double s, double t, double lod, double texel[4]) {
+    if (lod <= 0.0) {
+        refSampleLevel(scene, levels[0], scene.texMagFilter, s, t, texel);
+        return;
+    }
+    const GLenum levelFilter = (scene.texMinFilter == GL_NEAREST || scene.texMinFilter == GL_NEAREST_MIPMAP_NEAREST ||
+                                scene.texMinFilter == GL_NEAREST_MIPMAP_LINEAR) ? GL_NEAREST : GL_LINEAR;
+    const int maxLevel = static_cast<int>(levels.size()) - 1;
+    lod = std::min(lod, static_cast<double>(maxLevel));
+    if (scene.texMinFilter == GL_NEAREST_MIPMAP_NEAREST || scene.texMinFilter == GL_LINEAR_MIPMAP_NEAREST) {
+        refSampleLevel(scene, levels[static_cast<int>(floor(lod + 0.5))], levelFilter, s, t, texel);
+        return;
+    }
+    const int level = static_cast<int>(floor(lod));
+    refSampleLevel(scene, levels[level], levelFilter, s, t, texel);
+    if (level < maxLevel) {
+        double next[4];
+        refSampleLevel(scene, levels[level + 1], levelFilter, s, t, next);
+        for (int c = 0; c < 4; c++) {
+            texel[c] += (next[c] - texel[c])*(lod - level);
+        }
+    }
+}
+
+static std::vector<RefVertex> refClipPolygon(const std::vector<RefVertex> &poly, double sign) {
+    // Keeps the part with sign*z <= w, that is z >= -w for the near plane (sign = -1) and z <= w for the far one
+    std::vector<RefVertex> result;
+    for (size_t i = 0; i < poly.size(); i++) {
+        const RefVertex &a = poly[i];
+        const RefVertex &b = poly[(i + 1) % poly.size()];
+        const double da = a.pos[3] - sign*a.pos[2];
+        const double db = b.pos[3] - sign*b.pos[2];
+        if (da >= 0.0) {
+            result.push_back(a);
+        }
+        if ((da >= 0.0) != (db >= 0.0)) {
+            const double t = da / (da - db);
+            RefVertex v;
+            for (int j = 0; j < 4; j++) {
+                v.pos[j] = a.pos[j] + (b.pos[j] - a.pos[j])*t;
+                v.color[j] = a.color[j] + (b.color[j] - a.color[j])*t;
+            }
+            for (int j = 0; j < 2; j++) {
+                v.texCoord[j] = a.texCoord[j] + (b.texCoord[j] - a.texCoord[j])*t;
+            }
+            result.push_back(v);
+        }
+    }
+    return result;
+}
+
+// Draws into one image per sample, with a single one its offset is 0. The color is computed at the pixel center, the
+// depth at the samples. The shaded pixels are counted in the first image
+static void refDrawTriangle(const Scene &scene, const std::vector<RefTextureLevel> &texLevels, std::vector<Image> &samples, RefVertex verts[3]) {
+    const int samplesCount = static_cast<int>(samples.size());
+    const int sampleMaxOffset = (samplesCount > 1) ? MSAA_SAMPLE_MAX_OFFSET : 0;
+    Image &image = samples[0];
+
+    // Snap to the sub-pixel grid
+    int64_t fx[3], fy[3];
+    for (int i = 0; i < 3; i++) {
+        fx[i] = static_cast<int64_t>(floor(verts[i].pos[0]*256.0 + 0.5));
+        fy[i] = static_cast<int64_t>(floor(verts[i].pos[1]*256.0 + 0.5));
+    }
+
+    int64_t area = (fx[1] - fx[0])*(fy[2] - fy[0]) - (fy[1] - fy[0])*(fx[2] - fx[0]);
+    if (area == 0) {
+        return;
+    }
+
+    // y points down, so a negative area is counter-clockwise in window coordinates
+    if (scene.isCullFace) {
+        const bool isCCW = area < 0;
+        const bool isFront = isCCW == (scene.frontFace == GL_CCW);
+        if (scene.cullFace == GL_FRONT_AND_BACK || (scene.cullFace == GL_FRONT) == isFront) {
+            return;
+        }
+    }
+
+    int order[3] = { 0, 1, 2 };
+    if (area < 0) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    const double zMin = std::min({ verts[0].pos[2], verts[1].pos[2], verts[2].pos[2] });
+    const double zMax = std::max({ verts[0].pos[2], verts[1].pos[2], verts[2].pos[2] });
+    const int64_t minX = std::max<int64_t>((std::min({ fx[0], fx[1], fx[2] }) - sampleMaxOffset + 255) >> 8, 0);
+    const int64_t minY = std::max<int64_t>((std::min({ fy[0], fy[1], fy[2] }) - sampleMaxOffset + 255) >> 8, 0);
+    const int64_t maxX = std::min<int64_t>((std::max({ fx[0], fx[1], fx[2] }) + sampleMaxOffset) >> 8, image.width - 1);
+    const int64_t maxY = std::min<int64_t>((std::max({ fy[0], fy[1], fy[2] }) + sampleMaxOffset) >> 8, image.height - 1);
+
+    // Perspective correct texture coordinates at any pixel, inside the triangle or not
+    auto getTexCoord = [&](int64_t px, int64_t py, double texCoord[2]) {
+        double invW = 0.0;
+        texCoord[0] = texCoord[1] = 0.0;
+        for (int i = 0; i < 3; i++) {
+            const int a = order[(i + 1) % 3];
+            const int b = order[(i + 2) % 3];
+            const int64_t e = (fx[b] - fx[a])*(py*256 - fy[a]) - (fy[b] - fy[a])*(px*256 - fx[a]);
+            const double weight = static_cast<double>(e) / static_cast<double>(area);
+            const RefVertex &v = verts[order[i]];
+            invW += weight / v.pos[3];
+            for (int j = 0; j < 2; j++) {
+                texCoord[j] += weight*v.texCoord[j] / v.pos[3];
+            }
+        }
+        texCoord[0] /= invW;
+        texCoord[1] /= invW;
+    };
+
+    // Barycentric weights at the sub-pixel position (x, y), returns whether it's inside the triangle
+    auto getWeights = [&](int64_t x, int64_t y, double weights[3]) {
+        bool isInside = true;
+        for (int i = 0; i < 3; i++) {
+            // Edge opposite to the vertex i, its function is the vertex's unnormalized barycentric weight
+            const int a = order[(i + 1) % 3];
+            const int b = order[(i + 2) % 3];
+            const int64_t edgeX = fx[b] - fx[a];
+            const int64_t edgeY = fy[b] - fy[a];
+            const int64_t e = edgeX*(y - fy[a]) - edgeY*(x - fx[a]);
+            // Clockwise on the screen, top edges go right and left edges go up
+            const bool isTopLeft = edgeY < 0 || (edgeY == 0 && edgeX > 0);
+            isInside = isInside && (e > 0 || (e == 0 && isTopLeft));
+            weights[i] = static_cast<double>(e) / static_cast<double>(area);
+        }
+        return isInside;
+    };
+
+    for (int64_t py = minY; py <= maxY; py++) {
+        for (int64_t px = minX; px <= maxX; px++) {
+            const size_t idx = px + py*image.width;
+            bool isPassed[MSAA_SAMPLES_COUNT] = {};
+            bool isShaded = false;
+            for (int s = 0; s < samplesCount; s++) {
+                const int64_t sx = px*256 + (samplesCount > 1 ? MSAA_SAMPLE_OFFSETS[s][0] : 0);
+                const int64_t sy = py*256 + (samplesCount > 1 ? MSAA_SAMPLE_OFFSETS[s][1] : 0);
+                double weights[3];
+                if (!getWeights(sx, sy, weights)) {
+                    continue;
+                }
+
+                double z = 0.0;
+                for (int i = 0; i < 3; i++) {
+                    z += weights[i]*verts[order[i]].pos[2];
+                }
+                const float depth = static_cast<float>(std::min(std::max(z, zMin), zMax));
+                if (scene.isDepthTest) {
+                    if (!refDepthTest(scene.depthFunc, depth, samples[s].depth[idx])) {
+                        continue;
+                    }
+                    if (scene.isDepthWrite) {
+                        samples[s].depth[idx] = depth;
+                    }
+                }
+                isPassed[s] = true;
+                isShaded = true;
+            }
+            if (!isShaded) {
+                continue;
+            }
+            image.shadedPixelsCount++;
+
+            double weights[3];
+            getWeights(px*256, py*256, weights);
+            double color[4] = {};
+            for (int i = 0; i < 3; i++) {
+                const RefVertex &v = verts[order[i]];
+                for (int c = 0; c < 4; c++) {
+                    color[c] += weights[i]*v.color[c];
+                }
+            }
+
+            uint8_t src[4];
+            for (int c = 0; c < 4; c++) {
+                src[c] = static_cast<uint8_t>(std::min(std::max(floor(color[c] + 0.5), 0.0), 255.0));
+            }
+            if (scene.isTexture) {
+                // Level of detail from the derivatives at the top left pixel of the 2x2 quad
+                double texCoord[2], quad[3][2];
+                getTexCoord(px, py, texCoord);
+                getTexCoord(px & ~1, py & ~1, quad[0]);
+                getTexCoord((px & ~1) + 1, py & ~1, quad[1]);
+                getTexCoord(px & ~1, (py & ~1) + 1, quad[2]);
+                double lengths[2];
+                for (int d = 0; d < 2; d++) {
+                    const double du = (quad[d + 1][0] - quad[0][0])*scene.texWidth;
+                    const double dv = (quad[d + 1][1] - quad[0][1])*scene.texHeight;
+                    lengths[d] = du*du + dv*dv;
+                }
+                const double lod = 0.5*log2(std::max(lengths[0], lengths[1]));
+
+                double texel[4];
+                refSampleTexture(scene, texLevels, texCoord[0], texCoord[1], lod, texel);
+                for (int c = 0; c < 4; c++) {
+                    src[c] = static_cast<uint8_t>(floor(src[c]*texel[c] / 255.0 + 0.5));
+                }
+            }
+            for (int s = 0; s < samplesCount; s++) {
+                if (!isPassed[s]) {
+                    continue;
+                }
+                uint8_t *dst = reinterpret_cast<uint8_t*>(&samples[s].color[idx]);
+                uint8_t result[4];
+                memcpy(result, src, sizeof(result));
+                if (scene.isBlend) {
+                    refBlend(scene, src, dst, result);
+                }
+                for (int c = 0; c < 4; c++) {
+                    if (scene.colorMask[c]) {
+                        dst[c] = result[c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// With several samples the colors are averaged and the depth is the first sample's
+static Image renderReference(const Scene &scene, int samplesCount = 1) {
+    Image image;
+    image.width = IMAGE_WIDTH;
+    image.height = IMAGE_HEIGHT;
+    uint32_t clearColor;
+    uint8_t *clearBytes = reinterpret_cast<uint8_t*>(&clearColor);
+    for (int c = 0; c < 4; c++) {
+        clearBytes[c] = toColorByte(scene.clearColor[c]);
+    }
+    image.color.assign(IMAGE_WIDTH*IMAGE_HEIGHT, clearColor);
+    image.depth.assign(IMAGE_WIDTH*IMAGE_HEIGHT, scene.clearDepth);
+    std::vector<Image> samples(samplesCount, image);
+
+    double mvp[16];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            double sum = 0.0;
+            for (int k = 0; k < 4; k++) {
+                sum += static_cast<double>(scene.projMat[k*4 + r])*scene.modelViewMat[c*4 + k];
+            }
+            mvp[c*4 + r] = sum;
+        }
+    }
+
+    // glViewport(0, 0, w, h) maps [-1, 1] to [0, w] and [0, h] with y flipped, depth is kept in [-1, 1]
+    const double halfWidth = IMAGE_WIDTH*0.5;
+    const double halfHeight = IMAGE_HEIGHT*0.5;
+    const std::vector<RefTextureLevel> texLevels = scene.isTexture ? refMakeTextureLevels(scene) : std::vector<RefTextureLevel>();
+
+    for (const SceneDraw &draw : scene.draws) {
+        std::vector<RefVertex> verts;
+        for (const SceneVertex &sv : draw.vertices) {
+            RefVertex v;
+            const double pos[4] = { sv.pos[0], sv.pos[1], sv.pos[2], 1.0 };
+            for (int r = 0; r < 4; r++) {
+                v.pos[r] = mvp[r]*pos[0] + mvp[4 + r]*pos[1] + mvp[8 + r]*pos[2] + mvp[12 + r]*pos[3];
+            }
+            for (int c = 0; c < 4; c++) {
+                v.color[c] = toColorByte(sv.color[c]);
+            }
+            for (int j = 0; j < 2; j++) {
+                v.texCoord[j] = sv.texCoord[j];
+            }
+            verts.push_back(v);
+        }
+
+        std::vector<std::vector<RefVertex>> triangles;
+        if (draw.primType == GL_QUADS) {
+            for (size_t i = 0; i + 3 < verts.size(); i += 4) {
+                triangles.push_back({ verts[i], verts[i + 1], verts[i + 2] });
+                triangles.push_back({ verts[i], verts[i + 2], verts[i + 3] });
+            }
+        }
+        else {
+            for (size_t i = 0; i + 2 < verts.size(); i += 3) {
+                triangles.push_back({ verts[i], verts[i + 1], verts[i + 2] });
+            }
+        }
+
+        for (const auto &triangle : triangles) {
+            const std::vector<RefVertex> poly = refClipPolygon(refClipPolygon(triangle, -1.0), 1.0);
+            std::vector<RefVertex> screen = poly;
+            for (RefVertex &v : screen) {
+                const double invW = 1.0 / v.pos[3];
+                v.pos[0] = v.pos[0]*invW*halfWidth + halfWidth;
+                v.pos[1] = -v.pos[1]*invW*halfHeight + halfHeight;
+                v.pos[2] = v.pos[2]*invW;
+            }
+            for (size_t i = 1; i + 1 < screen.size(); i++) {
+                RefVertex fan[3] = { screen[0], screen[i], screen[i + 1] };
+                refDrawTriangle(scene, texLevels, samples, fan);
+            }
+        }
+    }
+
+    image = samples[0];
+    for (size_t idx = 0; idx < image.color.size(); idx++) {
+        uint32_t rgba = 0;
+        for (int c = 0; c < 32; c += 8) {
+            uint32_t sum = samplesCount / 2;
+            for (const Image &sample : samples) {
+                sum += (sample.color[idx] >> c) & 0xFF;
+            }
+            rgba |= (sum / samplesCount) << c;
+        }
+        image.color[idx] = rgba;
+    }
+    return image;
+}
+
+// ############################################################################################
+
+static bool writePPM(const std::string &path, const Image &image) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+    for (uint32_t rgba : image.color) {
+        const uint8_t rgb[3] = { static_cast<uint8_t>(rgba), static_cast<uint8_t>(rgba >> 8), static_cast<uint8_t>(rgba >> 16) };
+        fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+    return true;
+}
+
+// Grayscale PFM, rows are stored bottom to top with a negative scale for little endian
+static bool writePFM(const std::string &path, const Image &image) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "Pf\n%d %d\n-1.0\n", image.width, image.height);
+    for (int y = image.height - 1; y >= 0; y--) {
+        fwrite(&image.depth[y*image.width], sizeof(float), image.width, file);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool isColorEqual(uint32_t lhs, uint32_t rhs, int tolerance) {
+    for (int c = 0; c < 4; c++) {
+        const int diff = static_cast<int>((lhs >> (c*8)) & 0xFF) - static_cast<int>((rhs >> (c*8)) & 0xFF);
+        if (diff > tolerance || diff < -tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the number of pixels whose color or depth differ by more than the tolerances, marking them in diff
+static int compareImages(const Image &image, const Image &reference, int colorTolerance, float depthTolerance, Image *diff) {
+    int mismatchCount = 0;
+    if (diff) {
+        *diff = reference;
+    }
+    for (size_t i = 0; i < image.color.size(); i++) {
+        const bool isDepthEqual = fabsf(image.depth[i] - reference.depth[i]) <= depthTolerance ||
+                                  (std::isnan(image.depth[i]) && std::isnan(reference.depth[i]));
+        const bool isEqual = isColorEqual(image.color[i], reference.color[i], colorTolerance) && isDepthEqual;
+        if (!isEqual) {
+            mismatchCount++;
+        }
+        if (diff) {
+            // Matching pixels are dimmed, mismatching ones are red
+            diff->color[i] = isEqual ? ((reference.color[i] >> 2) & 0x3F3F3F3F) | 0xFF000000 : 0xFF0000FF;
+        }
+    }
+    return mismatchCount;
+}
+
+static bool isImageIdentical(const Image &lhs, const Image &rhs) {
+    return lhs.color == rhs.color &&
+           memcmp(lhs.depth.data(), rhs.depth.data(), lhs.depth.size()*sizeof(float)) == 0 &&
+           lhs.shadedPixelsCount == rhs.shadedPixelsCount;
+}
+
+// Returns the first row of a buffer with rows pitch pixels apart which differs from the image's colors, or -1
+static int findColorMismatch(const std::vector<uint32_t> &buffer, int pitch, const Image &image) {
+    for (int y = 0; y < IMAGE_HEIGHT; y++) {
+        if (memcmp(&buffer[static_cast<size_t>(y)*pitch], &image.color[y*IMAGE_WIDTH], IMAGE_WIDTH*sizeof(uint32_t)) != 0) {
+            return y;
+        }
+    }
+    return -1;
+}
+
+// Draws the scene and swaps, then draws two more frames while holding the completed one, which must stay unchanged
+static bool checkSwapChain(GLContext *ctx, const Scene &scene, const Image &image) {
+    const Image backImage = renderScene(ctx, scene);
+    bool isPassed = isImageIdentical(backImage, image);
+    if (!isPassed) {
+        printf("FAIL %s: rendering with a swap chain differs in %d pixels\n", scene.name.c_str(), compareImages(backImage, image, 0, 0.0f, nullptr));
+    }
+    vglContextSwapBuffers(ctx);
+    glFinish();
+
+    const void *colorBuffer;
+    int pitch;
+    uint64_t frame;
+    if (!vglContextAcquireFrame(ctx, colorBuffer, pitch, frame)) {
+        printf("FAIL %s: no completed frame after swapping\n", scene.name.c_str());
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        vglContextSwapBuffers(ctx);
+    }
+    glFinish();
+
+    for (int y = 0; y < IMAGE_HEIGHT; y++) {
+        if (memcmp(static_cast<const uint8_t*>(colorBuffer) + y*pitch, &image.color[y*IMAGE_WIDTH], IMAGE_WIDTH*sizeof(uint32_t)) != 0) {
+            printf("FAIL %s: acquired frame changed in row %d while the next frames were drawn\n", scene.name.c_str(), y);
+            isPassed = false;
+            break;
+        }
+    }
+
+    const void *latestBuffer;
+    uint64_t latestFrame;
+    if (!vglContextAcquireFrame(ctx, latestBuffer, pitch, latestFrame) || latestFrame != frame + 2 || latestBuffer == colorBuffer) {
+        printf("FAIL %s: latest frame is not the one swapped last\n", scene.name.c_str());
+        isPassed = false;
+    }
+    else {
+        vglContextReleaseFrame(ctx, latestFrame);
+    }
+    vglContextReleaseFrame(ctx, frame);
+    return isPassed;
+}
+
+// Names given to glNewList, from 1 to LARGE_LIST_NAME, must not be generated while they are compiled and
+// must be freed again by glDeleteLists. Generated names are only reserved, glIsList is false until they are defined
+static bool checkListNames() {
+    GLContext *ctx = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextMakeCurrent(ctx);
+    bool isPassed = true;
+
+    glNewList(1, GL_COMPILE);
+    const GLuint generated = glGenLists(2);
+    glEndList();
+    if (generated != 2 || !glIsList(1) || glIsList(2) || glIsList(3)) {
+        printf("FAIL display list names: glGenLists returned %u while list 1 was compiled\n", generated);
+        isPassed = false;
+    }
+    if (glGenLists(1) != 4) {
+        printf("FAIL display list names: generated names which are not defined yet were generated again\n");
+        isPassed = false;
+    }
+
+    glNewList(LARGE_LIST_NAME, GL_COMPILE);
+    glBegin(GL_TRIANGLES);
+    glVertex3f(-1.0f, -1.0f, 0.0f);
+    glVertex3f(1.0f, -1.0f, 0.0f);
+    glVertex3f(0.0f, 1.0f, 0.0f);
+    glEnd();
+    glEndList();
+    if (!glIsList(LARGE_LIST_NAME) || glIsList(LARGE_LIST_NAME - 1)) {
+        printf("FAIL display list names: list %u is not defined alone\n", LARGE_LIST_NAME);
+        isPassed = false;
+    }
+    glDeleteLists(1, LARGE_LIST_NAME);
+    if (glIsList(1) || glIsList(3) || glIsList(LARGE_LIST_NAME) || glGenLists(1) != 1) {
+        printf("FAIL display list names: glDeleteLists left names behind\n");
+        isPassed = false;
+    }
+    glDeleteLists(1, 1);
+    if (glGenLists(LARGE_LIST_NAME) != 1 || glGenLists(1) != LARGE_LIST_NAME + 1) {
+        printf("FAIL display list names: a range of %u names was not generated\n", LARGE_LIST_NAME);
+        isPassed = false;
+    }
+
+    vglContextMakeCurrent(nullptr);
+    vglContextDestroy(ctx);
+    if (isPassed) {
+        printf("ok   display list names\n");
+    }
+    return isPassed;
+}
+
+// Draws GL rejects must not draw anything: a negative first element and draws between glBegin and glEnd
+static bool checkInvalidDraws() {
+    GLContext *ctx = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextMakeCurrent(ctx);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+    const float triangles[] = {
+        -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    };
+    const GLuint indices[] = { 0, 1, 2 };
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, triangles + 9);
+    vglContextResetStats(ctx);
+    glDrawArrays(GL_TRIANGLES, -3, 3);
+    glBegin(GL_TRIANGLES);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, indices);
+    glEnd();
+
+    VGLStats stats;
+    vglContextGetStats(ctx, stats);
+    vglContextMakeCurrent(nullptr);
+    vglContextDestroy(ctx);
+    if (stats.trianglesSubmitted != 0 || stats.pixelsPassed != 0) {
+        printf("FAIL invalid draws: %llu triangles submitted\n", static_cast<unsigned long long>(stats.trianglesSubmitted));
+        return false;
+    }
+    printf("ok   invalid draws\n");
+    return true;
+}
+
+// Prints a failure of the query check when value isn't the expected one
+static bool checkCount(const char *name, const char *what, uint64_t value, uint64_t expected) {
+    if (value != expected) {
+        printf("FAIL %s: %s is %llu, expected %llu\n", name, what, static_cast<unsigned long long>(value), static_cast<unsigned long long>(expected));
+        return false;
+    }
+    return true;
+}
+
+// Draws a viewport sized grid of shared vertices with the queries active and checks their results and the pipeline
+// statistics against the known counts. Resetting the statistics in the middle must not affect the active queries.
+// With multisampling the queries count samples, and pixels on the shared edges count once for every triangle
+static bool checkQueries(const char *name, bool isDeferred, int samplesCount) {
+    GLContext *ctx = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextSetDeferred(ctx, isDeferred);
+    vglContextSetSampleCount(ctx, samplesCount);
+    vglContextMakeCurrent(ctx);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnableClientState(GL_VERTEX_ARRAY);
+
+    // 4x4 quads, each vertex is used by up to 6 triangles but transformed once. They reach past the viewport inside
+    // the guard band, so they also cover the samples of the first row and column, which lie before the pixel centers
+    constexpr int gridSize = 4;
+    constexpr int gridVertsCount = (gridSize + 1)*(gridSize + 1);
+    constexpr int gridIndicesCount = gridSize*gridSize*6;
+    constexpr uint64_t pixelsCount = IMAGE_WIDTH*IMAGE_HEIGHT;
+    std::vector<float> gridPositions;
+    std::vector<GLushort> gridIndices;
+    for (int y = 0; y <= gridSize; y++) {
+        for (int x = 0; x <= gridSize; x++) {
+            gridPositions.insert(gridPositions.end(), { -1.1f + 2.2f*x / gridSize, -1.1f + 2.2f*y / gridSize, 0.0f });
+            if (x < gridSize && y < gridSize) {
+                const GLushort i = static_cast<GLushort>(x + y*(gridSize + 1));
+                const GLushort right = i + 1, up = i + gridSize + 1, upRight = i + gridSize + 2;
+                gridIndices.insert(gridIndices.end(), { i, right, upRight, i, upRight, up });
+            }
+        }
+    }
+    const auto drawGrid = [&](float z) {
+        for (int i = 0; i < gridVertsCount; i++) {
+            gridPositions[i*3 + 2] = z;
+        }
+        glVertexPointer(3, GL_FLOAT, 0, gridPositions.data());
+        glDrawElements(GL_TRIANGLES, gridIndicesCount, GL_UNSIGNED_SHORT, gridIndices.data());
+    };
+
+    enum { SAMPLES_QUERY, ANY_SAMPLES_QUERY, TIME_QUERY, START_TIMESTAMP, END_TIMESTAMP, NO_SAMPLES_QUERY, QUERIES_COUNT };
+    GLuint queries[QUERIES_COUNT];
+    glGenQueries(QUERIES_COUNT, queries);
+    bool isPassed = true;
+    VGLStats stats;
+
+    const auto start = std::chrono::steady_clock::now();
+    glQueryCounter(queries[START_TIMESTAMP], GL_TIMESTAMP);
+    vglContextResetStats(ctx);
+    glBeginQuery(GL_SAMPLES_PASSED, queries[SAMPLES_QUERY]);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[ANY_SAMPLES_QUERY]);
+    glBeginQuery(GL_TIME_ELAPSED, queries[TIME_QUERY]);
+    drawGrid(0.0f);
+    vglContextGetStats(ctx, stats);
+    isPassed = checkCount(name, "verticesSubmitted", stats.verticesSubmitted, gridIndicesCount) && isPassed;
+    isPassed = checkCount(name, "verticesTransformed", stats.verticesTransformed, gridVertsCount) && isPassed;
+    isPassed = checkCount(name, "vertexCacheHits", stats.vertexCacheHits, gridIndicesCount - gridVertsCount) && isPassed;
+    isPassed = checkCount(name, "trianglesSubmitted", stats.trianglesSubmitted, gridIndicesCount / 3) && isPassed;
+    isPassed = checkCount(name, "trianglesClipped", stats.trianglesClipped, 0) && isPassed;
+    isPassed = checkCount(name, "trianglesCulled", stats.trianglesCulled, 0) && isPassed;
+    isPassed = checkCount(name, "trianglesRasterized", stats.trianglesRasterized, gridIndicesCount / 3) && isPassed;
+    if (samplesCount == 1) {
+        isPassed = checkCount(name, "pixelsTested", stats.pixelsTested, pixelsCount) && isPassed;
+        isPassed = checkCount(name, "pixelsPassed", stats.pixelsPassed, pixelsCount) && isPassed;
+    }
+    else if (stats.pixelsPassed < pixelsCount || stats.pixelsTested != stats.pixelsPassed) {
+        printf("FAIL %s: %llu pixels tested and %llu passed, expected %llu at least\n", name, static_cast<unsigned long long>(stats.pixelsTested),
+               static_cast<unsigned long long>(stats.pixelsPassed), static_cast<unsigned long long>(pixelsCount));
+        isPassed = false;
+    }
+    isPassed = checkCount(name, "samplesPassed", stats.samplesPassed, pixelsCount*samplesCount) && isPassed;
+
+    // Behind the first grid, the hierarchical depth rejects all the blocks before their pixels are tested
+    vglContextResetStats(ctx);
+    drawGrid(0.5f);
+    glEndQuery(GL_TIME_ELAPSED);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    glEndQuery(GL_SAMPLES_PASSED);
+    glQueryCounter(queries[END_TIMESTAMP], GL_TIMESTAMP);
+    vglContextGetStats(ctx, stats);
+    isPassed = checkCount(name, "pixelsTested after the reset", stats.pixelsTested, 0) && isPassed;
+    isPassed = checkCount(name, "pixelsPassed after the reset", stats.pixelsPassed, 0) && isPassed;
+    isPassed = checkCount(name, "samplesPassed after the reset", stats.samplesPassed, 0) && isPassed;
+
+    GLuint available = GL_FALSE;
+    GLuint samplesPassed = 0;
+    GLuint64 anySamplesPassed = 0;
+    GLuint64 timeElapsed = 0;
+    GLuint64 startTimestamp = 0;
+    GLuint64 endTimestamp = 0;
+    glGetQueryObjectuiv(queries[SAMPLES_QUERY], GL_QUERY_RESULT_AVAILABLE, &available);
+    glGetQueryObjectuiv(queries[SAMPLES_QUERY], GL_QUERY_RESULT, &samplesPassed);
+    glGetQueryObjectui64v(queries[ANY_SAMPLES_QUERY], GL_QUERY_RESULT, &anySamplesPassed);
+    glGetQueryObjectui64v(queries[TIME_QUERY], GL_QUERY_RESULT, &timeElapsed);
+    glGetQueryObjectui64v(queries[START_TIMESTAMP], GL_QUERY_RESULT, &startTimestamp);
+    glGetQueryObjectui64v(queries[END_TIMESTAMP], GL_QUERY_RESULT, &endTimestamp);
+    const auto wallTime = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    isPassed = checkCount(name, "GL_QUERY_RESULT_AVAILABLE", available, GL_TRUE) && isPassed;
+    isPassed = checkCount(name, "GL_SAMPLES_PASSED", samplesPassed, pixelsCount*samplesCount) && isPassed;
+    isPassed = checkCount(name, "GL_ANY_SAMPLES_PASSED", anySamplesPassed, GL_TRUE) && isPassed;
+    if (timeElapsed == 0 || timeElapsed > wallTime || endTimestamp - startTimestamp < timeElapsed || endTimestamp - startTimestamp > wallTime) {
+        printf("FAIL %s: GL_TIME_ELAPSED is %llu ns and the timestamps are %llu ns apart, %llu ns passed\n", name,
+               static_cast<unsigned long long>(timeElapsed), static_cast<unsigned long long>(endTimestamp - startTimestamp),
+               static_cast<unsigned long long>(wallTime));
+        isPassed = false;
+    }
+
+    // A triangle outside the view volume, one crossing the far plane, which is clipped into 2, and one culled
+    // as both front and back facing. None of them is in front of the first grid
+    const float triangles[] = {
+        2.0f, 0.0f, 0.5f, 3.0f, 0.0f, 0.5f, 2.0f, 1.0f, 0.5f,
+        -1.0f, -1.0f, 0.5f, 1.0f, -1.0f, 0.5f, 0.0f, 1.0f, 3.0f,
+        -1.0f, -1.0f, 0.5f, 1.0f, -1.0f, 0.5f, 0.0f, 1.0f, 0.5f,
+    };
+    vglContextResetStats(ctx);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[NO_SAMPLES_QUERY]);
+    glVertexPointer(3, GL_FLOAT, 0, triangles);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT_AND_BACK);
+    glDrawArrays(GL_TRIANGLES, 6, 3);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    vglContextGetStats(ctx, stats);
+    anySamplesPassed = GL_TRUE;
+    glGetQueryObjectui64v(queries[NO_SAMPLES_QUERY], GL_QUERY_RESULT, &anySamplesPassed);
+    isPassed = checkCount(name, "GL_ANY_SAMPLES_PASSED behind the grid", anySamplesPassed, GL_FALSE) && isPassed;
+    isPassed = checkCount(name, "verticesSubmitted of the arrays", stats.verticesSubmitted, 9) && isPassed;
+    isPassed = checkCount(name, "verticesTransformed of the arrays", stats.verticesTransformed, 9) && isPassed;
+    isPassed = checkCount(name, "vertexCacheHits of the arrays", stats.vertexCacheHits, 0) && isPassed;
+    isPassed = checkCount(name, "trianglesSubmitted of the arrays", stats.trianglesSubmitted, 3) && isPassed;
+    isPassed = checkCount(name, "trianglesClipped", stats.trianglesClipped, 1) && isPassed;
+    isPassed = checkCount(name, "trianglesCulled", stats.trianglesCulled, 2) && isPassed;
+    isPassed = checkCount(name, "trianglesRasterized", stats.trianglesRasterized, 2) && isPassed;
+    isPassed = checkCount(name, "pixelsPassed behind the grid", stats.pixelsPassed, 0) && isPassed;
+
+    glDeleteQueries(QUERIES_COUNT, queries);
+    vglContextMakeCurrent(nullptr);
+    vglContextDestroy(ctx);
+    if (isPassed) {
+        printf("ok   %s\n", name);
+    }
+    return isPassed;
+}
+
+int main(int argc, char **argv) {
+    std::string dumpDir;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--dump") && i + 1 < argc) {
+            dumpDir = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else {
+            printf("Usage: VGLConformance [--dump DIR] [--filter TEXT]\n");
+            return 1;
+        }
+    }
+
+    // The unorm formats are compared with the default D32F context
+    const struct {
+        const char *name;
+        VGLDepthFormat format;
+        float tolerance;
+    } depthFormats[] = {
+        { "D24S8", VGL_DEPTH_D24S8, DEPTH_TOLERANCE },
+        { "D16", VGL_DEPTH_D16, DEPTH_TOLERANCE + 2.0f / 0xFFFF },
+    };
+    GLContext *formatContexts[std::size(depthFormats)];
+    for (size_t i = 0; i < std::size(depthFormats); i++) {
+        formatContexts[i] = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT, depthFormats[i].format);
+        vglContextMakeCurrent(formatContexts[i]);
+        glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+    }
+
+    GLContext *deferredContext = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextSetDeferred(deferredContext, true);
+    vglContextMakeCurrent(deferredContext);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    // Draws into buffers of the test, with padded color rows
+    constexpr int externalPitch = IMAGE_WIDTH + EXTERNAL_PADDING;
+    std::vector<uint32_t> externalColor(externalPitch*IMAGE_HEIGHT, EXTERNAL_PADDING_VALUE);
+    std::vector<float> externalDepth(IMAGE_WIDTH*IMAGE_HEIGHT);
+    GLContext *externalContext = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextSetExternalBuffers(externalContext, externalColor.data(), externalPitch*sizeof(uint32_t), externalDepth.data());
+    vglContextSetThreadCount(externalContext, 3);
+    vglContextMakeCurrent(externalContext);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    GLContext *swapChainContext = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextSetSwapChain(swapChainContext, 3);
+    vglContextSetDeferred(swapChainContext, true);
+    vglContextMakeCurrent(swapChainContext);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    std::vector<uint32_t> msaaExternalColor(IMAGE_WIDTH*IMAGE_HEIGHT);
+    GLContext *msaaContext = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextSetSampleCount(msaaContext, MSAA_SAMPLES_COUNT);
+    vglContextSetThreadCount(msaaContext, 3);
+    vglContextMakeCurrent(msaaContext);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    GLContext *ctx = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+    vglContextMakeCurrent(ctx);
+    glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+    const VGLSimdLevel supportedLevel = vglGetSimdLevel();
+    const int threadCounts[] = { 1, 3, 8 };
+
+    const std::vector<Scene> scenes = createScenes();
+    std::vector<const Scene*> testedScenes;
+    std::vector<Image> sceneImages;
+    int failedCount = 0;
+    for (const Scene &scene : scenes) {
+        if (!filter.empty() && scene.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        const Image reference = renderReference(scene);
+        bool isPassed = true;
+
+        vglSetSimdLevel(VGL_SIMD_SSE2);
+        vglContextSetThreadCount(ctx, 1);
+        const Image image = renderScene(ctx, scene);
+
+        Image diff;
+        const int mismatchCount = compareImages(image, reference, COLOR_TOLERANCE, DEPTH_TOLERANCE, &diff);
+        const int maxMismatchCount = static_cast<int>(scene.maxMismatchRatio*IMAGE_WIDTH*IMAGE_HEIGHT);
+        const int64_t shadedDiff = static_cast<int64_t>(image.shadedPixelsCount) - static_cast<int64_t>(reference.shadedPixelsCount);
+        if (mismatchCount > maxMismatchCount || shadedDiff > maxMismatchCount || shadedDiff < -maxMismatchCount) {
+            printf("FAIL %s: %d pixels differ from the reference (max %d), %llu shaded pixels vs %llu\n", scene.name.c_str(),
+                   mismatchCount, maxMismatchCount, static_cast<unsigned long long>(image.shadedPixelsCount),
+                   static_cast<unsigned long long>(reference.shadedPixelsCount));
+            isPassed = false;
+        }
+
+        // The optimized paths must not change a single bit
+        for (int level = VGL_SIMD_SSE2; level <= supportedLevel; level++) {
+            for (int threadCount : threadCounts) {
+                vglSetSimdLevel(static_cast<VGLSimdLevel>(level));
+                vglContextSetThreadCount(ctx, threadCount);
+                const Image variant = renderScene(ctx, scene);
+                if (!isImageIdentical(variant, image)) {
+                    printf("FAIL %s: SIMD level %d with %d threads differs from SIMD level 0 with 1 thread in %d pixels\n",
+                           scene.name.c_str(), level, threadCount, compareImages(variant, image, 0, 0.0f, nullptr));
+                    isPassed = false;
+                }
+            }
+        }
+        vglSetSimdLevel(supportedLevel);
+
+        // Clears written right away instead of per tile
+        vglContextSetFastClear(ctx, false);
+        const Image slowClearImage = renderScene(ctx, scene);
+        vglContextSetFastClear(ctx, true);
+        if (!isImageIdentical(slowClearImage, image)) {
+            printf("FAIL %s: rendering without fast clears differs in %d pixels\n", scene.name.c_str(),
+                   compareImages(slowClearImage, image, 0, 0.0f, nullptr));
+            isPassed = false;
+        }
+
+        // Commands executed by the worker, after the client arrays and indices are gone
+        vglContextMakeCurrent(deferredContext);
+        const Image deferredImage = renderScene(deferredContext, scene);
+        vglContextMakeCurrent(ctx);
+        if (!isImageIdentical(deferredImage, image)) {
+            printf("FAIL %s: deferred rendering differs in %d pixels\n", scene.name.c_str(), compareImages(deferredImage, image, 0, 0.0f, nullptr));
+            isPassed = false;
+        }
+
+        // With fast clears and without, the padding must stay untouched. The memory holds the frame after glFinish,
+        // without reading the buffers through the context, which would write the pending clears
+        vglContextMakeCurrent(externalContext);
+        for (bool isFastClear : { true, false }) {
+            vglContextSetFastClear(externalContext, isFastClear);
+            std::fill(externalColor.begin(), externalColor.end(), EXTERNAL_PADDING_VALUE);
+            drawScene(scene);
+            glFinish();
+            const int mismatchRow = findColorMismatch(externalColor, externalPitch, image);
+            if (mismatchRow >= 0 || memcmp(externalDepth.data(), image.depth.data(), externalDepth.size()*sizeof(float)) != 0) {
+                printf("FAIL %s: external buffers differ after glFinish%s, color from row %d\n", scene.name.c_str(),
+                       isFastClear ? " with fast clears" : "", mismatchRow);
+                isPassed = false;
+            }
+
+            const Image externalImage = renderScene(externalContext, scene);
+            if (!isImageIdentical(externalImage, image)) {
+                printf("FAIL %s: rendering into external buffers differs in %d pixels\n", scene.name.c_str(),
+                       compareImages(externalImage, image, 0, 0.0f, nullptr));
+                isPassed = false;
+            }
+        }
+        vglContextMakeCurrent(ctx);
+        for (int y = 0; y < IMAGE_HEIGHT; y++) {
+            for (int x = IMAGE_WIDTH; x < externalPitch; x++) {
+                if (externalColor[x + y*externalPitch] != EXTERNAL_PADDING_VALUE) {
+                    printf("FAIL %s: padding of the external color buffer written at %d, %d\n", scene.name.c_str(), x, y);
+                    isPassed = false;
+                    y = IMAGE_HEIGHT;
+                    break;
+                }
+            }
+        }
+
+        vglContextMakeCurrent(swapChainContext);
+        isPassed = checkSwapChain(swapChainContext, scene, image) && isPassed;
+        vglContextMakeCurrent(ctx);
+
+        // Multisampling against the multisampled reference, every SIMD level and slow clears must give the same bits
+        const Image msaaReference = renderReference(scene, MSAA_SAMPLES_COUNT);
+        vglContextMakeCurrent(msaaContext);
+        vglSetSimdLevel(VGL_SIMD_SSE2);
+        const Image msaaImage = renderScene(msaaContext, scene);
+        for (int level = VGL_SIMD_SSE2; level <= supportedLevel; level++) {
+            vglSetSimdLevel(static_cast<VGLSimdLevel>(level));
+            vglContextSetFastClear(msaaContext, level != supportedLevel);
+            const Image variant = renderScene(msaaContext, scene);
+            if (!isImageIdentical(variant, msaaImage)) {
+                printf("FAIL %s: multisampling with SIMD level %d differs from SIMD level 0 in %d pixels\n", scene.name.c_str(), level,
+                       compareImages(variant, msaaImage, 0, 0.0f, nullptr));
+                isPassed = false;
+            }
+        }
+        vglContextSetFastClear(msaaContext, true);
+
+        // Samples resolved into external memory by glFinish
+        vglContextSetExternalBuffers(msaaContext, msaaExternalColor.data(), IMAGE_WIDTH*sizeof(uint32_t));
+        drawScene(scene);
+        glFinish();
+        vglContextSetExternalBuffers(msaaContext, nullptr, 0);
+        vglContextMakeCurrent(ctx);
+        const int msaaMismatchRow = findColorMismatch(msaaExternalColor, IMAGE_WIDTH, msaaImage);
+        if (msaaMismatchRow >= 0) {
+            printf("FAIL %s: multisampled external color buffer differs after glFinish from row %d\n", scene.name.c_str(), msaaMismatchRow);
+            isPassed = false;
+        }
+
+        const int msaaMismatchCount = compareImages(msaaImage, msaaReference, COLOR_TOLERANCE, DEPTH_TOLERANCE, nullptr);
+        const int64_t msaaShadedDiff = static_cast<int64_t>(msaaImage.shadedPixelsCount) - static_cast<int64_t>(msaaReference.shadedPixelsCount);
+        if (msaaMismatchCount > maxMismatchCount || msaaShadedDiff > maxMismatchCount || msaaShadedDiff < -maxMismatchCount) {
+            printf("FAIL %s: multisampling differs from the reference in %d pixels (max %d), %llu shaded pixels vs %llu\n", scene.name.c_str(),
+                   msaaMismatchCount, maxMismatchCount, static_cast<unsigned long long>(msaaImage.shadedPixelsCount),
+                   static_cast<unsigned long long>(msaaReference.shadedPixelsCount));
+            isPassed = false;
+        }
+
+        for (size_t i = 0; i < std::size(depthFormats); i++) {
+            vglContextMakeCurrent(formatContexts[i]);
+            const Image formatImage = renderScene(formatContexts[i], scene);
+            vglContextMakeCurrent(ctx);
+
+            const int formatMismatchCount = compareImages(formatImage, image, COLOR_TOLERANCE, depthFormats[i].tolerance, nullptr);
+            const int maxFormatMismatchCount = static_cast<int>((scene.maxMismatchRatio + DEPTH_FORMAT_MISMATCH_RATIO)*IMAGE_WIDTH*IMAGE_HEIGHT);
+            if (formatMismatchCount > maxFormatMismatchCount) {
+                printf("FAIL %s: %s depth differs from D32F in %d pixels (max %d)\n", scene.name.c_str(), depthFormats[i].name,
+                       formatMismatchCount, maxFormatMismatchCount);
+                isPassed = false;
+            }
+        }
+
+        if (!dumpDir.empty()) {
+            const std::string base = dumpDir + "/" + scene.name;
+            if (!writePPM(base + ".ppm", image) || !writePFM(base + "_depth.pfm", image) || !writePPM(base + "_ref.ppm", reference) ||
+                !writePFM(base + "_ref_depth.pfm", reference) || !writePPM(base + "_diff.ppm", diff)) {
+                printf("Can't write the images of %s to %s\n", scene.name.c_str(), dumpDir.c_str());
+            }
+        }
+
+        if (isPassed) {
+            printf("ok   %s (%d pixels differ from the reference)\n", scene.name.c_str(), mismatchCount);
+        }
+        else {
+            failedCount++;
+        }
+        testedScenes.push_back(&scene);
+        sceneImages.push_back(image);
+    }
+    const int scenesCount = static_cast<int>(testedScenes.size());
+
+    // Every thread draws all the scenes into its own context, starting from a different one, so different
+    // scenes are drawn at the same time. Half of the contexts rasterize with a thread pool of their own
+    std::vector<std::vector<Image>> concurrentImages(CONCURRENT_CONTEXTS_COUNT, std::vector<Image>(testedScenes.size()));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < CONCURRENT_CONTEXTS_COUNT; t++) {
+        threads.emplace_back([&, t]() {
+            GLContext *threadContext = vglContextCreate(IMAGE_WIDTH, IMAGE_HEIGHT);
+            vglContextSetThreadCount(threadContext, 1 + t % 2);
+            vglContextMakeCurrent(threadContext);
+            glViewport(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT);
+            for (size_t i = 0; i < testedScenes.size(); i++) {
+                const size_t sceneIdx = (i + t) % testedScenes.size();
+                concurrentImages[t][sceneIdx] = renderScene(threadContext, *testedScenes[sceneIdx]);
+            }
+            vglContextMakeCurrent(nullptr);
+            vglContextDestroy(threadContext);
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    bool isConcurrentPassed = true;
+    for (int t = 0; t < CONCURRENT_CONTEXTS_COUNT; t++) {
+        for (size_t i = 0; i < testedScenes.size(); i++) {
+            if (!isImageIdentical(concurrentImages[t][i], sceneImages[i])) {
+                printf("FAIL %s: context drawn concurrently on thread %d differs in %d pixels\n", testedScenes[i]->name.c_str(), t,
+                       compareImages(concurrentImages[t][i], sceneImages[i], 0, 0.0f, nullptr));
+                isConcurrentPassed = false;
+            }
+        }
+    }
+    if (isConcurrentPassed) {
+        printf("ok   %d contexts drawing concurrently\n", CONCURRENT_CONTEXTS_COUNT);
+    }
+
+    const bool isListNamesPassed = checkListNames();
+    const bool isInvalidDrawsPassed = checkInvalidDraws();
+    const bool isQueriesPassed = checkQueries("queries and statistics", false, 1);
+    const bool isDeferredQueriesPassed = checkQueries("queries and statistics, deferred", true, 1);
+    const bool isMultisampleQueriesPassed = checkQueries("queries and statistics, multisampled", false, MSAA_SAMPLES_COUNT);
+
+    vglContextMakeCurrent(nullptr);
+    vglContextDestroy(ctx);
+    vglContextDestroy(deferredContext);
+    vglContextDestroy(externalContext);
+    vglContextDestroy(swapChainContext);
+    vglContextDestroy(msaaContext);
+    for (GLContext *formatContext : formatContexts) {
+        vglContextDestroy(formatContext);
+    }
+
+    printf("%d of %d scenes passed\n", scenesCount - failedCount, scenesCount);
+    return (failedCount == 0 && isConcurrentPassed && isListNamesPassed && isInvalidDrawsPassed && isQueriesPassed && isDeferredQueriesPassed && isMultisampleQueriesPassed) ? 0 : 1;
+}